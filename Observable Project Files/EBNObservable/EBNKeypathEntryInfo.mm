@@ -6,11 +6,114 @@
 	Copyright (c) 2013-2018 eBay Software Foundation.
 */
 
+#import <pthread.h>
+
 #import "EBNObservableInternal.h"
 
 #import <UIKit/UIGeometry.h>
 
 
+	// The intern tables. Both are guarded by EBNKeypathInternLock. They hold their keypaths and components weakly,
+	// so a keypath goes away once no observation uses it. NSMapTable isn't documented as safe for concurrent
+	// readers, so this is a mutex and not a read/write lock.
+static pthread_mutex_t			EBNKeypathInternLock = PTHREAD_MUTEX_INITIALIZER;
+static NSMapTable				*EBNKeypathInternTable;		// NSString -> EBNKeypath, weak values
+static NSMapTable				*EBNKeypathComponentTable;	// NSString -> the same NSString, interned, weak
+static NSUInteger				EBNKeypathNextID = 1;
+
+/**
+	EBNKeypath is an interned, parsed keypath. Observing the same keypath on thousands of objects
+	makes thousands of EBNKeypathEntryInfo objects, but only one of these.
+*/
+@implementation EBNKeypath
+
+/****************************************************************************************************
+	keypathForString:
+	
+	The keypath is only interned while something holds on to it; callers that need the same keypath
+	object later (observations, via their keypath entries) must keep a strong reference.
+*/
++ (EBNKeypath *) keypathForString:(NSString *) keypathString
+{
+	pthread_mutex_lock(&EBNKeypathInternLock);
+	if (!EBNKeypathInternTable)
+	{
+		EBNKeypathInternTable = [NSMapTable strongToWeakObjectsMapTable];
+		EBNKeypathComponentTable = [NSMapTable weakToWeakObjectsMapTable];
+	}
+	
+	EBNKeypath *keypath = [EBNKeypathInternTable objectForKey:keypathString];
+	if (!keypath)
+	{
+		keypath = [[EBNKeypath alloc] init];
+		keypath->_string = [keypathString copy];
+		keypath->_keypathID = EBNKeypathNextID++;
+		
+		NSMutableArray *components = [[NSMutableArray alloc] init];
+		for (NSString *component in [keypathString componentsSeparatedByString:@"."])
+		{
+			NSString *internedComponent = [EBNKeypathComponentTable objectForKey:component];
+			if (!internedComponent)
+			{
+				internedComponent = [component copy];
+				[EBNKeypathComponentTable setObject:internedComponent forKey:internedComponent];
+			}
+			[components addObject:internedComponent];
+		}
+		keypath->_components = [components copy];
+		
+		[EBNKeypathInternTable setObject:keypath forKey:keypath->_string];
+	}
+	pthread_mutex_unlock(&EBNKeypathInternLock);
+
+	return keypath;
+}
+
+/****************************************************************************************************
+	existingKeypathForString:
+	
+*/
++ (EBNKeypath *) existingKeypathForString:(NSString *) keypathString
+{
+	pthread_mutex_lock(&EBNKeypathInternLock);
+	EBNKeypath *keypath = [EBNKeypathInternTable objectForKey:keypathString];
+	pthread_mutex_unlock(&EBNKeypathInternLock);
+	
+	return keypath;
+}
+
+/****************************************************************************************************
+	count
+	
+*/
+- (NSUInteger) count
+{
+	return _components.count;
+}
+
+/****************************************************************************************************
+	objectAtIndexedSubscript:
+	
+*/
+- (NSString *) objectAtIndexedSubscript:(NSUInteger) index
+{
+	return _components[index];
+}
+
+/****************************************************************************************************
+	description
+	
+*/
+- (NSString *) description
+{
+	return _string;
+}
+
+@end
+
+#pragma mark -
+
+
 /**
 	EBNKeypathEntryInfo is pretty much just a data struct. Its purpose is to track a keypath
 	through all the objects in the path. Each object in a keypath will have one of these structs.
@@ -37,7 +140,7 @@
 		// The blockInfo must be an identity match for the keypathInfos to be considered equal.
 		if (_blockInfo == otherKeypathEntry->_blockInfo &&
 				_keyPathIndex == otherKeypathEntry->_keyPathIndex &&
-				[_keyPath isEqualToArray:otherKeypathEntry->_keyPath])
+				_keyPath == otherKeypathEntry->_keyPath)
 		{
 			return YES;
 		}
@@ -52,7 +155,7 @@
 */
 - (NSUInteger) hash
 {
-	return ((NSUInteger) _blockInfo) ^ _keyPathIndex ^ [_keyPath hash];
+	return ((NSUInteger) _blockInfo) ^ _keyPathIndex ^ (_keyPath->_keypathID << 8);
 }
 
 /****************************************************************************************************
@@ -219,7 +322,7 @@
 */
 - (NSString *) description
 {
-	NSString *returnStr = [NSString stringWithFormat:@"Path:\"%@\": %@", self->_keyPath,
+	NSString *returnStr = [NSString stringWithFormat:@"Path:\"%@\": %@", self->_keyPath->_string,
 			[self->_blockInfo debugDescription]];
 	return returnStr;
 }
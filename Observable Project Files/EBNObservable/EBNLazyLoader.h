@@ -120,6 +120,10 @@
 	from its getter method, only recalculating its value after one of the invalidate methods is called.
 
 	This property will automatically invalidate its value whenever the value of any of the keyPaths change.
+	
+	Keypaths that are a single property of the receiver, including other synthetic properties, form a
+	dependency graph for the class. A change invalidates everything downstream of it in one pass, and observers
+	are notified in dependency order, so that each synthetic property is recomputed at most once.
 
 	@param property The proprety to make synthetic
 	@param keyPaths  An array of keypaths. Paths must be rooted at the receiver.
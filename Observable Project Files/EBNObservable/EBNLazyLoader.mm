@@ -22,6 +22,7 @@
 #import <CoreGraphics/CGGeometry.h>
 #import <objc/message.h>
 #import <atomic>
+#import <vector>
 #import <pthread/pthread.h>
 
 #import "EBNLazyLoader.h"
@@ -55,15 +56,353 @@ static uint32_t sBlockCreationIndex = 0;
 @implementation LazyLoaderConstructionInfo
 @end
 
+/**
+	Bits for synthetic properties past the end of an object's inline validity bitfield. Chunks are allocated
+	the first time one of their bits gets set, and are then never moved or freed until the object deallocs.
+*/
+static const NSInteger kEBNValidityChunkWords = 8;
+
+struct EBNValidityOverflowChunk
+{
+	std::atomic<uint32_t>					words[kEBNValidityChunkWords];
+	std::atomic<EBNValidityOverflowChunk *>	next;
+};
+
 /**
 	The type of the bitfield of valid properties for an object. This can be found  as a runtime-generated ivar 
-	in the object directly.
+	in the object directly. The inline part of the bitfield is sized by counting the class's properties when
+	its shadow class is made; properties registered past that (from categories loaded later, for instance) 
+	have their bits in a chain of overflow chunks. 
+	
+	A property's bit index is its index in the shadow class info's _getters, which is only ever appended to,
+	so indexes are stable.
 */
 typedef struct ValidPropertiesStruct
 {
-	std::atomic<uint32_t>	propertyBitfield[];
+	std::atomic<EBNValidityOverflowChunk *>	overflow;
+	std::atomic<uint32_t>					propertyBitfield[];
 } ValidPropertiesStruct;
 
+/****************************************************************************************************
+	EBNValidityWord()
+	
+	Returns the bitfield word holding the bit for propIndex. Indexes in the inline bitfield go straight there.
+	For overflow indexes, walks the chunk chain, adding chunks as needed if create is true. Returns NULL 
+	if create is false and the chunk doesn't exist yet, meaning the property isn't valid.
+	
+	inlineBitCount is always a multiple of 32, so a property's bit mask is the same either way.
+*/
+static inline std::atomic<uint32_t> *EBNValidityWord(ValidPropertiesStruct *validProperties, NSInteger inlineBitCount,
+		NSInteger propIndex, bool create)
+{
+	if (propIndex < inlineBitCount)
+		return validProperties->propertyBitfield + propIndex / 32;
+
+	NSInteger overflowWord = (propIndex - inlineBitCount) / 32;
+	std::atomic<EBNValidityOverflowChunk *> *link = &validProperties->overflow;
+	while (true)
+	{
+		EBNValidityOverflowChunk *chunk = link->load(std::memory_order_acquire);
+		if (!chunk)
+		{
+			if (!create)
+				return NULL;
+			
+			// If another thread adds the chunk first, use theirs
+			EBNValidityOverflowChunk *newChunk = new EBNValidityOverflowChunk();
+			if (link->compare_exchange_strong(chunk, newChunk, std::memory_order_acq_rel))
+				chunk = newChunk;
+			else
+				delete newChunk;
+		}
+		
+		if (overflowWord < kEBNValidityChunkWords)
+			return chunk->words + overflowWord;
+		overflowWord -= kEBNValidityChunkWords;
+		link = &chunk->next;
+	}
+}
+
+/****************************************************************************************************
+	EBNForEachValidityWord()
+	
+	Calls body with each word of the bitfield that exists, and the bit index of the word's first bit.
+*/
+template<typename F> static void EBNForEachValidityWord(ValidPropertiesStruct *validProperties,
+		NSInteger inlineBitCount, F body)
+{
+	for (NSInteger longIndex = 0; longIndex < (inlineBitCount + 31) / 32; ++longIndex)
+	{
+		body(validProperties->propertyBitfield[longIndex].load(), longIndex * 32);
+	}
+	
+	NSInteger firstBitIndex = inlineBitCount;
+	for (EBNValidityOverflowChunk *chunk = validProperties->overflow.load(std::memory_order_acquire); chunk;
+			chunk = chunk->next.load(std::memory_order_acquire))
+	{
+		for (NSInteger wordIndex = 0; wordIndex < kEBNValidityChunkWords; ++wordIndex)
+		{
+			body(chunk->words[wordIndex].load(), firstBitIndex);
+			firstBitIndex += 32;
+		}
+	}
+}
+
+/****************************************************************************************************
+	EBNFreezePropertyIndexes()
+	
+	Makes the immutable property name to bit index table for a shadow class. Called once, when the class
+	is registered; the class can't get new synthetic properties after that. Caller must hold the sync.
+*/
+static NSDictionary *EBNFreezePropertyIndexes(EBNShadowedClassInfo *classInfo)
+{
+	NSMutableDictionary *propertyIndexes = [[NSMutableDictionary alloc] initWithCapacity:classInfo->_getters.count];
+	[classInfo->_getters enumerateObjectsUsingBlock:^(NSString *propName, NSUInteger index, BOOL *stop)
+	{
+		propertyIndexes[propName] = @(index);
+	}];
+	
+	return [propertyIndexes copy];
+}
+
+/****************************************************************************************************
+	EBNVisitDependencyGraph()
+	
+	Depth-first search through the properties that depend on propName. Appends each property to postOrder
+	after all of its dependents, so postOrder reversed is a topological order.
+*/
+static void EBNVisitDependencyGraph(NSString *propName, NSDictionary *dependents, NSMutableSet *visited,
+		NSMutableSet *inProgress, NSMutableArray *postOrder, Class baseClass)
+{
+	if ([visited containsObject:propName])
+		return;
+	if ([inProgress containsObject:propName])
+	{
+		EBLogContext(kLoggingContextOther, @"Synthetic property %@ of class %@ depends on itself. It will still "
+				@"get invalidated, but in no particular order with the other properties in the cycle.",
+				propName, baseClass);
+		return;
+	}
+	
+	[inProgress addObject:propName];
+	for (NSString *dependentName in dependents[propName])
+	{
+		EBNVisitDependencyGraph(dependentName, dependents, visited, inProgress, postOrder, baseClass);
+	}
+	[inProgress removeObject:propName];
+	
+	[visited addObject:propName];
+	[postOrder addObject:propName];
+}
+
+/****************************************************************************************************
+	EBNFreezeDependencyGraph()
+	
+	Builds the class's dependency graph out of the dependencies its synthetic properties declared on other
+	properties of the same object. Sorts the synthetic properties topologically, and for each property that
+	something depends on, makes the sorted list of everything that depends on it, directly or not.
+	
+	Called once, when the class is registered. Caller must hold the sync.
+*/
+static void EBNFreezeDependencyGraph(EBNShadowedClassInfo *classInfo)
+{
+	NSDictionary *dependents = classInfo->_syntheticDependents;
+	NSMutableSet *visited = [[NSMutableSet alloc] init];
+	NSMutableSet *inProgress = [[NSMutableSet alloc] init];
+	NSMutableArray *postOrder = [[NSMutableArray alloc] init];
+	for (NSString *propName in classInfo->_getters)
+	{
+		EBNVisitDependencyGraph(propName, dependents, visited, inProgress, postOrder, classInfo->_baseClass);
+	}
+	for (NSString *propName in dependents)
+	{
+		EBNVisitDependencyGraph(propName, dependents, visited, inProgress, postOrder, classInfo->_baseClass);
+	}
+	
+	// Only synthetic properties have bit indexes; the rest are just there to get the order right
+	NSMutableDictionary *topologicalRanks = [[NSMutableDictionary alloc] initWithCapacity:postOrder.count];
+	NSMutableArray *topologicalOrder = [[NSMutableArray alloc] initWithCapacity:classInfo->_getters.count];
+	for (NSString *propName in [postOrder reverseObjectEnumerator])
+	{
+		topologicalRanks[propName] = @(topologicalRanks.count);
+		NSUInteger propIndex = [classInfo->_getters indexOfObject:propName];
+		if (propIndex != NSNotFound)
+			[topologicalOrder addObject:@(propIndex)];
+	}
+	
+	NSMutableDictionary *transitiveDependents = [[NSMutableDictionary alloc] initWithCapacity:dependents.count];
+	for (NSString *propName in dependents)
+	{
+		NSMutableSet *reachable = [[NSMutableSet alloc] init];
+		NSMutableArray *toVisit = [[dependents[propName] array] mutableCopy];
+		while (toVisit.count)
+		{
+			NSString *dependentName = [toVisit lastObject];
+			[toVisit removeLastObject];
+			if ([dependentName isEqualToString:propName] || [reachable containsObject:dependentName])
+				continue;
+			
+			[reachable addObject:dependentName];
+			[toVisit addObjectsFromArray:[dependents[dependentName] array]];
+		}
+		
+		NSArray *sortedDependents = [[reachable allObjects] sortedArrayUsingComparator:^NSComparisonResult(NSString *a, NSString *b)
+		{
+			return [topologicalRanks[a] compare:topologicalRanks[b]];
+		}];
+		NSMutableArray *dependentIndexes = [[NSMutableArray alloc] initWithCapacity:sortedDependents.count];
+		for (NSString *dependentName in sortedDependents)
+		{
+			NSUInteger propIndex = [classInfo->_getters indexOfObject:dependentName];
+			if (propIndex != NSNotFound)
+				[dependentIndexes addObject:@(propIndex)];
+		}
+		transitiveDependents[propName] = [dependentIndexes copy];
+	}
+	
+	classInfo->_frozenTopologicalOrder = [topologicalOrder copy];
+	classInfo->_frozenDependents = [transitiveDependents copy];
+}
+
+/****************************************************************************************************
+	EBNMarkPropertyValid()
+	
+	Setters call this after every set, so it doesn't lock or send messages. Setters bake in propIndex
+	when they're created; ebn_markPropertyValid: passes NSNotFound and we look the property up in the
+	frozen table.
+*/
+void EBNMarkPropertyValid(NSObject *object, EBNShadowedClassInfo *info, NSInteger propIndex, NSString *propName)
+{
+	// No bitfield means no synthetic properties
+	if (!info->_validityIvarOffset)
+		return;
+	
+	if (propIndex == NSNotFound)
+	{
+		NSNumber *frozenIndex = info->_frozenPropertyIndexes[propName];
+		if (!frozenIndex)
+			return;
+		propIndex = [frozenIndex integerValue];
+	}
+	
+	uint8_t *objectCharPtr = (uint8_t *) ((__bridge void *) object);
+	ValidPropertiesStruct *validProperties = (ValidPropertiesStruct *) (objectCharPtr + info->_validityIvarOffset);
+	EBNValidityWord(validProperties, info->_validPropertyBitfieldSize, propIndex, true)->fetch_or(
+			(uint32_t) (1 << (propIndex & 31)));
+}
+
+/****************************************************************************************************
+	EBNAddDependentsToMask()
+	
+	Sets the bits of all the properties that depend on propName, directly or not, in mask.
+*/
+static void EBNAddDependentsToMask(EBNShadowedClassInfo *info, NSString *propName, std::vector<uint32_t> &mask)
+{
+	for (NSNumber *dependentIndexNumber in info->_frozenDependents[propName])
+	{
+		NSInteger dependentIndex = [dependentIndexNumber integerValue];
+		if (dependentIndex / 32 >= (NSInteger) mask.size())
+			mask.resize(dependentIndex / 32 + 1);
+		mask[dependentIndex / 32] |= (uint32_t) (1 << (dependentIndex & 31));
+	}
+}
+
+/****************************************************************************************************
+	EBNForEachIndexInMask()
+	
+	Calls body with the index of each bit set in mask, in topological order: properties come before the
+	synthetic properties that depend on them. Properties registered after the class froze its dependency
+	graph come last, in bit order.
+*/
+template<typename F> static void EBNForEachIndexInMask(EBNShadowedClassInfo *info, const std::vector<uint32_t> &mask,
+		F body)
+{
+	NSInteger numOrdered = (NSInteger) info->_frozenTopologicalOrder.count;
+	for (NSNumber *propIndexNumber in info->_frozenTopologicalOrder)
+	{
+		NSInteger propIndex = [propIndexNumber integerValue];
+		if (propIndex / 32 < (NSInteger) mask.size() && (mask[propIndex / 32] & (uint32_t) (1 << (propIndex & 31))))
+			body(propIndex);
+	}
+	
+	for (NSInteger propIndex = numOrdered; propIndex < (NSInteger) mask.size() * 32; ++propIndex)
+	{
+		if (mask[propIndex / 32] & (uint32_t) (1 << (propIndex & 31)))
+			body(propIndex);
+	}
+}
+
+/****************************************************************************************************
+	EBNInvalidatePropertiesInMask()
+	
+	Invalidates the synthetic properties of object whose bits are set in mask. Mask is indexed by bitfield
+	word: bit n of word w is the property with bit index w * 32 + n.
+	
+	Only properties that are valid get invalidated. Each word's bits get cleared with one atomic op. As with
+	invalidatePropertyValue:, properties with observers get their previous (cached) values boxed before
+	they're cleared, and their observers triggered after; properties nobody's observing just get cleared.
+	
+	Observers get triggered in topological order, after every property in the mask has been cleared. So an
+	observer that recomputes a property that depends on several invalidated properties sees all of their
+	new values, and no property gets invalidated and recomputed more than once.
+*/
+static void EBNInvalidatePropertiesInMask(NSObject *object, EBNShadowedClassInfo *info,
+		ValidPropertiesStruct *validProperties, std::vector<uint32_t> &mask)
+{
+	NSInteger inlineBitCount = info->_validPropertyBitfieldSize;
+	EBNObservationTable *observationTable = [object ebn_observationTable:NO];
+	BOOL wildcardObserved = observationTable && [observationTable entriesForKey:@"*"] != nil;
+	
+	// Narrow the mask down to valid properties
+	for (NSInteger wordIndex = 0; wordIndex < (NSInteger) mask.size(); ++wordIndex)
+	{
+		std::atomic<uint32_t> *bitfieldWord = EBNValidityWord(validProperties, inlineBitCount, wordIndex * 32, false);
+		mask[wordIndex] = bitfieldWord ? mask[wordIndex] & bitfieldWord->load() : 0;
+	}
+	
+	// Get the previous values of the observed ones. Previous values have to be read while the properties
+	// are still valid, so that they're the cached values.
+	std::vector<NSInteger> observedIndexes;
+	NSMutableArray *previousValues = nil;
+	if (observationTable)
+	{
+		EBNForEachIndexInMask(info, mask, [&](NSInteger propIndex)
+		{
+			NSString *propName = propIndex < (NSInteger) info->_frozenGetters.count ? info->_frozenGetters[propIndex] : nil;
+			if (propName && (wildcardObserved || [observationTable entriesForKey:propName]))
+			{
+				if (!previousValues)
+					previousValues = [[NSMutableArray alloc] init];
+				id prevValue = [object ebn_valueForKey:propName];
+				[previousValues addObject:prevValue ? prevValue : [NSNull null]];
+				observedIndexes.push_back(propIndex);
+			}
+		});
+	}
+	
+	// Clear the bits. If another thread invalidated a property since we looked, it'll have told the observers.
+	for (NSInteger wordIndex = 0; wordIndex < (NSInteger) mask.size(); ++wordIndex)
+	{
+		if (mask[wordIndex])
+		{
+			std::atomic<uint32_t> *bitfieldWord = EBNValidityWord(validProperties, inlineBitCount, wordIndex * 32, false);
+			mask[wordIndex] &= bitfieldWord->fetch_and(~mask[wordIndex]);
+		}
+	}
+	
+	// Tell observers. This calls out to observer blocks, which could make properties valid again.
+	for (size_t observedIndex = 0; observedIndex < observedIndexes.size(); ++observedIndex)
+	{
+		NSInteger propIndex = observedIndexes[observedIndex];
+		if (mask[propIndex / 32] & (uint32_t) (1 << (propIndex & 31)))
+		{
+			id prevValue = previousValues[observedIndex];
+			[object ebn_manuallyTriggerObserversForProperty:info->_frozenGetters[propIndex]
+					previousValue:prevValue == [NSNull null] ? nil : prevValue];
+		}
+	}
+}
+
 
 template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *constructionInfo);
 
@@ -91,42 +430,7 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 */
 + (void) syntheticProperty:(NSString *) property dependsOn:(NSString *) keyPathString
 {
-	EBNShadowedClassInfo *classInfo = [self ebn_wrapPropertyMethods:property customLoader:nil copyFromProperty:nil];
-	if (!classInfo)
-		return;
-
-	if (keyPathString)
-	{
-		// Set up our observation, with nil set for observed and observer
-		EBNObservation *blockInfo = [[EBNObservation alloc] initForObserved:nil observer:nil
-				immedBlock:^(id blockSelf, id observed)
-		{
-			[blockSelf invalidatePropertyValue:property];
-		}];
-		blockInfo.isForLazyLoader = YES;
-		
-#if defined(DEBUG) && DEBUG
-		[blockInfo setDebugString:[NSString stringWithFormat:
-				@"%p: Global synthetic property invalidation observation for \"%@\" of class <%@>",
-				blockInfo, property, classInfo->_shadowClass]];
-#endif
-
-		// Create a keypath entry
-		EBNKeypathEntryInfo	*entryInfo = [[EBNKeypathEntryInfo alloc] init];
-		entryInfo->_blockInfo = blockInfo;
-		entryInfo->_keyPath = [keyPathString componentsSeparatedByString:@"."];
-		entryInfo->_keyPathIndex = 0;
-		
-		@synchronized(EBNBaseClassToShadowInfoTable)
-		{
-			// Add the keypath entry to the global observations to be copied into objects during alloc
-			// This can be thought of as being similar to an NSInvocation in that it 'freeze-dries' an observeration
-			// for later deployment.
-			if (!classInfo->_globalObservations)
-				classInfo->_globalObservations = [[NSMutableArray alloc] init];
-			[classInfo->_globalObservations addObject:entryInfo];
-		}
-	}
+	[self syntheticProperty:property dependsOnPaths:keyPathString ? @[keyPathString] : nil];
 }
 
 /****************************************************************************************************
@@ -134,6 +438,11 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	
 	Declares property to be a lazy-loading synthetic property whose value is dependent on all the
 	paths in keyPaths.
+	
+	Paths that are just a property of the receiver become edges in the class's dependency graph. Each property
+	that something depends on gets one global observation, which invalidates everything depending on it in a
+	single pass. Longer paths get an observation that invalidates property (and so its dependents) when
+	anything along the path changes.
 */
 + (void) syntheticProperty:(NSString *) property dependsOnPaths:(NSArray *) keyPaths
 {
@@ -141,7 +450,56 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	if (!classInfo)
 		return;
 	
-	if (keyPaths && keyPaths.count)
+	NSMutableArray *remoteKeyPaths = [[NSMutableArray alloc] init];
+	@synchronized(EBNBaseClassToShadowInfoTable)
+	{
+		for (NSString *keyPathString in keyPaths)
+		{
+			if ([keyPathString rangeOfString:@"."].location != NSNotFound || [keyPathString isEqualToString:@"*"])
+			{
+				[remoteKeyPaths addObject:keyPathString];
+				continue;
+			}
+			
+			if (!classInfo->_syntheticDependents)
+				classInfo->_syntheticDependents = [[NSMutableDictionary alloc] init];
+			NSMutableOrderedSet *directDependents = classInfo->_syntheticDependents[keyPathString];
+			if (!directDependents)
+			{
+				directDependents = [[NSMutableOrderedSet alloc] init];
+				classInfo->_syntheticDependents[keyPathString] = directDependents;
+				
+				// The first dependency on this property sets up the observation of it
+				EBNObservation *blockInfo = [[EBNObservation alloc] initForObserved:nil observer:nil
+				immedBlock:^(id blockSelf, id observed)
+				{
+					[blockSelf ebn_invalidateDependentsOfProperty:keyPathString];
+				}];
+				blockInfo.isForLazyLoader = YES;
+				
+#if defined(DEBUG) && DEBUG
+				[blockInfo setDebugString:[NSString stringWithFormat:
+						@"%p: Global synthetic property invalidation observation for dependents of \"%@\" of class <%@>",
+						blockInfo, keyPathString, classInfo->_shadowClass]];
+#endif
+
+				// Add the keypath entry to the global observations to be copied into objects during alloc
+				// This can be thought of as being similar to an NSInvocation in that it 'freeze-dries' an observeration
+				// for later deployment.
+				EBNKeypathEntryInfo	*entryInfo = [[EBNKeypathEntryInfo alloc] init];
+				entryInfo->_blockInfo = blockInfo;
+				entryInfo->_keyPath = [EBNKeypath keypathForString:keyPathString];
+				entryInfo->_keyPathIndex = 0;
+				
+				if (!classInfo->_globalObservations)
+					classInfo->_globalObservations = [[NSMutableArray alloc] init];
+				[classInfo->_globalObservations addObject:entryInfo];
+			}
+			[directDependents addObject:property];
+		}
+	}
+	
+	if (remoteKeyPaths.count)
 	{
 		// Set up our observation, with nil set for observed and observer
 		EBNObservation *blockInfo = [[EBNObservation alloc] initForObserved:nil observer:nil
@@ -162,12 +520,12 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 			if (!classInfo->_globalObservations)
 				classInfo->_globalObservations = [[NSMutableArray alloc] init];
 
-			for (NSString *keyPathString in keyPaths)
+			for (NSString *keyPathString in remoteKeyPaths)
 			{
 				// Create a keypath entry
 				EBNKeypathEntryInfo	*entryInfo = [[EBNKeypathEntryInfo alloc] init];
 				entryInfo->_blockInfo = blockInfo;
-				entryInfo->_keyPath = [keyPathString componentsSeparatedByString:@"."];
+				entryInfo->_keyPath = [EBNKeypath keypathForString:keyPathString];
 				entryInfo->_keyPathIndex = 0;
 				
 				// Add it to the global observations
@@ -233,7 +591,7 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	// Create a keypath entry
 	EBNKeypathEntryInfo	*entryInfo = [[EBNKeypathEntryInfo alloc] init];
 	entryInfo->_blockInfo = blockInfo;
-	entryInfo->_keyPath = [observationKeypath componentsSeparatedByString:@"."];
+	entryInfo->_keyPath = [EBNKeypath keypathForString:observationKeypath];
 	entryInfo->_keyPathIndex = 0;
 	
 	@synchronized(EBNBaseClassToShadowInfoTable)
@@ -284,51 +642,46 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	
 	This method does NOT check to see if the property parameter is actually a property of the object,
 	and will throw an exception if it isn't. Use invalidatePropertyValues: which does do this check.
+	
+	A valid synthetic property gets invalidated along with everything that depends on it, in one pass.
 */
 - (void) invalidatePropertyValue:(NSString *) property
 {
-	BOOL wasValid = NO;
-	ValidPropertiesStruct *validProperties = nil;
+	std::atomic<uint32_t> *bitfieldWord = NULL;
+	ValidPropertiesStruct *validProperties = NULL;
 
-	// Is this property currently valid?
-	NSInteger propIndex = [self ebn_indexOfProperty:property];
+	// Is this property currently valid? If its overflow chunk doesn't exist, it's never been valid.
+	NSInteger inlineBitCount = 0;
+	NSInteger propIndex = [self ebn_indexOfProperty:property inlineBitCount:&inlineBitCount];
 	if (propIndex != NSNotFound)
 	{
 		validProperties = self.ebn_currentlyValidProperties;
 		if (validProperties)
 		{
-			// Get the bitfield, check whether the indexed bit is set.
-			uint32_t longLoad = validProperties->propertyBitfield[propIndex / 32];
-			wasValid = (longLoad & (1 << (propIndex & 31))) != 0;
+			bitfieldWord = EBNValidityWord(validProperties, inlineBitCount, propIndex, false);
 		}
 	}
-	else
+	uint32_t bitMask = (uint32_t) (1 << (propIndex & 31));
+	BOOL wasValid = bitfieldWord && (bitfieldWord->load() & bitMask) != 0;
+	
+	if (wasValid)
 	{
-		// This where we need to invalidate a property we're not actually tracking, as
-		// our fixed-size bitfield has run out of room. In this case we have to assume
-		// the property was previously valid, so that we'll notify observers.
-		wasValid = YES;
+		EBNShadowedClassInfo *info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
+		std::vector<uint32_t> mask(propIndex / 32 + 1);
+		mask[propIndex / 32] = bitMask;
+		EBNAddDependentsToMask(info, property, mask);
+		EBNInvalidatePropertiesInMask(self, info, validProperties, mask);
+		return;
 	}
 	
-	// A bit of inductive logic here: If the property wasn't previously valid, it wasn't being
-	// observed, as observed properties have to be forced valid. This is all being done because
-	// asking for prevValue won't recompute if wasValid is true.
-	if (wasValid)
+	// A bit of inductive logic here: If a synthetic property wasn't previously valid, it wasn't being
+	// observed, as observed properties have to be forced valid. Properties that aren't synthetic (and so
+	// have no validity bit) might have a cached value we don't know about. Assume they were valid, so that
+	// we'll notify observers.
+	if (propIndex == NSNotFound)
 	{
-		// This should get the cached (valid) value. Can't be done inside a synchronize.
+		// Can't be done inside a synchronize.
 		id prevValue = [self ebn_valueForKey:property];
-		
-		// validPropertyBitfield will be nil in the case where the property index is beyond the end
-		// of the bitfield
-		if (validProperties != nil)
-		{
-			// Now we remove the property from the valid list
-			std::atomic_fetch_and(validProperties->propertyBitfield + propIndex / 32, 
-					(uint32_t) ~(1 << (propIndex & 31)));
-		}
-		
-		// And call the manual trigger to tell observers about the change. Note that we only have to
-		// call this if wasValid was true, as if it was false there's no observers.
 		[self ebn_manuallyTriggerObserversForProperty:property previousValue:prevValue];
 	}
 }
@@ -345,35 +698,35 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 */
 - (void) invalidatePropertyValues:(NSSet *) properties
 {
-	// If there's no valid properties, exit early
-	if (![self ebn_hasValidProperties])
+	ValidPropertiesStruct *validProperties = self.ebn_currentlyValidProperties;
+	if (!validProperties)
 		return;
-
-	NSMutableOrderedSet *lazyProperties = nil;
 	
-	// Get the set of lazy getters from our subclass. If it doesn't exist or is empty we intersect against
-	// the null set and don't invalidate anything, which is what we want if we don't actually have lazy properties.
-	@synchronized(EBNBaseClassToShadowInfoTable)
+	EBNShadowedClassInfo *info = nil;
+	if (class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
 	{
-		EBNShadowedClassInfo *info = nil;
-		
-		if (class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
-		{
-			info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
-		}
-		
-		// Get all the registered lazy properties, and intersect that with the set of newly-invalid properties.
-		if (info && info->_getters)
-		{
-			lazyProperties = [info->_getters mutableCopy];
-			[lazyProperties intersectSet:properties];
-		}
+		info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
 	}
+	if (!info)
+		return;
 	
-	for (NSString *curProperty in lazyProperties)
+	// Make a mask of the properties that are synthetic. Anything not in the frozen index table isn't lazily
+	// loaded, so we skip it.
+	std::vector<uint32_t> mask;
+	for (NSString *curProperty in properties)
 	{
-		[self invalidatePropertyValue:curProperty];
+		NSNumber *propIndexNumber = info->_frozenPropertyIndexes[curProperty];
+		if (!propIndexNumber)
+			continue;
+		
+		NSInteger propIndex = [propIndexNumber integerValue];
+		if (propIndex / 32 >= (NSInteger) mask.size())
+			mask.resize(propIndex / 32 + 1);
+		mask[propIndex / 32] |= (uint32_t) (1 << (propIndex & 31));
+		EBNAddDependentsToMask(info, curProperty, mask);
 	}
+	
+	EBNInvalidatePropertiesInMask(self, info, validProperties, mask);
 }
 
 /****************************************************************************************************
@@ -396,29 +749,16 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	if (!info)
 		return;
 	
-	uint32_t hasValidProperties = 0;
-	for (int longIndex = 0; longIndex < (info->_validPropertyBitfieldSize + 31) / 32; ++longIndex)
-	{
-		hasValidProperties |= validProperties->propertyBitfield[longIndex];
-	}
-	
-	// If there's no valid properties, exit early
-	if (!hasValidProperties)
-		return;
-	
 	// rcf Also have to call invalidate on any properties that are being observed.
 	
-	for (NSUInteger longIndex = 0; longIndex < (info->_validPropertyBitfieldSize + 31) / 32; longIndex++)
+	// Everything that's valid now gets invalidated
+	std::vector<uint32_t> mask;
+	EBNForEachValidityWord(validProperties, info->_validPropertyBitfieldSize, [&](uint32_t bitfield, NSInteger)
 	{
-		uint32_t bitfield = validProperties->propertyBitfield[longIndex];
-		for (int bitIndex = 0; bitIndex < 32; ++bitIndex)
-		{
-			if (bitfield & (1 << bitIndex))
-			{
-				[self invalidatePropertyValue:[self ebn_propertyNameAtIndex:longIndex * 32 + bitIndex]];
-			}
-		}
-	}
+		mask.push_back(bitfield);
+	});
+	
+	EBNInvalidatePropertiesInMask(self, info, validProperties, mask);
 }
 
 /****************************************************************************************************
@@ -441,10 +781,10 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	
 	if (validProperties)
 	{
-		for (int longIndex = 0; longIndex < (info->_validPropertyBitfieldSize + 31) / 32; ++longIndex)
+		EBNForEachValidityWord(validProperties, info->_validPropertyBitfieldSize, [&](uint32_t bitfield, NSInteger)
 		{
-			hasValidProperties |= validProperties->propertyBitfield[longIndex];
-		}
+			hasValidProperties |= bitfield;
+		});
 	}
 
 	if (hasValidProperties)
@@ -455,6 +795,28 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 
 #pragma mark Private Methods
 
+/****************************************************************************************************
+	ebn_invalidateDependentsOfProperty:
+	
+	Called by the global observation on a property that synthetic properties of the receiver depend on.
+	Invalidates everything that depends on the property, directly or not, in one topologically ordered pass.
+	The property itself isn't invalidated; it's the one that changed.
+*/
+- (void) ebn_invalidateDependentsOfProperty:(NSString *) property
+{
+	ValidPropertiesStruct *validProperties = self.ebn_currentlyValidProperties;
+	if (!validProperties || !class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
+		return;
+	
+	EBNShadowedClassInfo *info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
+	if (!info)
+		return;
+	
+	std::vector<uint32_t> mask;
+	EBNAddDependentsToMask(info, property, mask);
+	EBNInvalidatePropertiesInMask(self, info, validProperties, mask);
+}
+
 /****************************************************************************************************
 	ebn_installAdditionalOverrides:
 	
@@ -464,7 +826,7 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	
 	This method installs overrides for:
 		+allocWithZone:
-		-ebn_observedKeysDict:
+		-ebn_observationTable:
 		-ebn_currentlyValidProperties 
 */
 + (void) ebn_installAdditionalOverrides:(EBNShadowedClassInfo *) classInfo actualClass:(Class) actualClass
@@ -537,8 +899,13 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 				{
 					if (!curClassInfo->_allocHasHappened)
 					{
-						// We have to register the new class.
+						// We have to register the new class. Its set of synthetic properties is final now,
+						// so freeze their validity bit indexes for lock-free lookups.
 						objc_registerClassPair(curClassInfo->_shadowClass);
+						curClassInfo->_frozenPropertyIndexes = EBNFreezePropertyIndexes(curClassInfo);
+						curClassInfo->_frozenGetters = [[curClassInfo->_getters array] copy];
+						EBNFreezeDependencyGraph(curClassInfo);
+						curClassInfo->_frozenForceValidThunks = [curClassInfo->_forceValidThunks copy];
 						curClassInfo->_allocHasHappened = YES;
 					}
 					shadowClassToAlloc = curClassInfo->_shadowClass;
@@ -570,66 +937,71 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	class_addMethod(metaClass, @selector(allocWithZone:),
 			(IMP) allocWithZoneMethodImplementation, method_getTypeEncoding(allocWithZoneMethod));
 
-////// 		ebn_observedKeysDict:	//////
+////// 		ebn_observationTable:	//////
 
-	// Add an ivar to the class that'll hold the observation dict; this will obviate having to store the
-	// dict in an associatied object.
-	BOOL addedObservationDictIvar = class_addIvar(shadowClass, "ebn_ObservationDictionary",
+	// Add an ivar to the class that'll hold the observation table; this will obviate having to store the
+	// table in an associatied object. Setter overrides for this class read the ivar directly.
+	BOOL addedObservationTableIvar = class_addIvar(shadowClass, "ebn_ObservationTable",
 			sizeof(id), log2(sizeof(id)), @encode(id));
 
-	if (addedObservationDictIvar)
+	if (addedObservationTableIvar)
 	{			
-		NSMutableDictionary *(^ebn_observedKeysDict_Override)(NSObject *, BOOL)  =
-		^NSMutableDictionary *(NSObject *blockSelf, BOOL createIfNil)
+		Ivar observationTableIvar = class_getInstanceVariable(shadowClass, "ebn_ObservationTable");
+		classInfo->_observationTableIvar = observationTableIvar;
+		EBNPropertySlotMap *slotMap = classInfo->_propertySlots;
+
+		EBNObservationTable *(^ebn_observationTable_Override)(NSObject *, BOOL)  =
+		^EBNObservationTable *(NSObject *blockSelf, BOOL createIfNil)
 		{
-			Ivar observationDictIvar = class_getInstanceVariable(shadowClass, "ebn_ObservationDictionary");
-			NSMutableDictionary *returnDict = object_getIvar(blockSelf, observationDictIvar);
-			if (!returnDict && createIfNil)
+			EBNObservationTable *returnTable = object_getIvar(blockSelf, observationTableIvar);
+			if (!returnTable && createIfNil)
 			{
 				@synchronized(EBNObservableSynchronizationToken)
 				{
 					// Recheck for non-nil inside the sync
-					returnDict = object_getIvar(blockSelf, observationDictIvar);
-					if (!returnDict)
+					returnTable = object_getIvar(blockSelf, observationTableIvar);
+					if (!returnTable)
 					{
-						returnDict = [[NSMutableDictionary alloc] init];
-						[blockSelf setValue:returnDict forKey:@"ebn_ObservationDictionary"];
+						returnTable = [[EBNObservationTable alloc] initWithSlotMap:slotMap];
+						[blockSelf setValue:returnTable forKey:@"ebn_ObservationTable"];
 					}
 				}
 			}
 			
-			return returnDict;
+			return returnTable;
 		};
-		IMP ebn_observedKeysDict_MethodImplementation = imp_implementationWithBlock(ebn_observedKeysDict_Override);
-		Method observedKeysMethod = class_getInstanceMethod(shadowClass, @selector(ebn_observedKeysDict:));
-		class_addMethod(shadowClass, @selector(ebn_observedKeysDict:),
-				(IMP) ebn_observedKeysDict_MethodImplementation, method_getTypeEncoding(observedKeysMethod));
+		IMP ebn_observationTable_MethodImplementation = imp_implementationWithBlock(ebn_observationTable_Override);
+		Method observationTableMethod = class_getInstanceMethod(shadowClass, @selector(ebn_observationTable:));
+		class_addMethod(shadowClass, @selector(ebn_observationTable:),
+				(IMP) ebn_observationTable_MethodImplementation, method_getTypeEncoding(observationTableMethod));
 		
 		// Add this ivar to the list of ivars to manually dealloc when we dealloc objects of this class
 		if (!classInfo->_objectGettersWithPrivateStorage)
 		{
 			classInfo->_objectGettersWithPrivateStorage = [NSMutableSet set];
 		}
-		[classInfo->_objectGettersWithPrivateStorage addObject:@"ebn_ObservationDictionary"];
+		[classInfo->_objectGettersWithPrivateStorage addObject:@"ebn_ObservationTable"];
 	}
 
 	// Determine how many properties these objects will have, and reserve ivar space for a bitfield
 	// large enough to have 1 bit per property. Since shadowClass may not be the direct child of baseClass
 	// in the case of other runtime-subclassers out there, count properties from shadow's super.
+	// Properties past this count still work; their bits go in overflow chunks.
 	int numProperties = [class_getSuperclass(shadowClass) ebn_countOfAllProperties];
 	classInfo->_validPropertyBitfieldSize = numProperties;
-	char typeDesc[32];
-	snprintf(typeDesc, 30, "[%dI]", numProperties / 32);
+	char typeDesc[48];
+	snprintf(typeDesc, sizeof(typeDesc), "{ValidPropertiesStruct=^v[%dI]}", numProperties / 32);
 
 ////// 		ebn_currentlyValidProperties	//////
 
 	// Add the ivar, and override the method that returns the bitfield pointer to return the ivar address
 	BOOL addedPropValidityIvar = class_addIvar(shadowClass, "ebn_PropertyValidityBitfield",
-			numProperties / 8, 2, typeDesc);
+			sizeof(ValidPropertiesStruct) + numProperties / 8, log2(sizeof(void *)), typeDesc);
 	if (addedPropValidityIvar)
 	{
 		Ivar propValidityIvar = class_getInstanceVariable(shadowClass, "ebn_PropertyValidityBitfield");
 		ptrdiff_t propValidityIvarOffset = ivar_getOffset(propValidityIvar);
+		classInfo->_validityIvarOffset = propValidityIvarOffset;
 
 		ValidPropertiesStruct *(^ebn_currentlyValidProperties)(NSObject *) =
 				^ValidPropertiesStruct *(NSObject *blockSelf)
@@ -733,13 +1105,12 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 		// We add the getter to the array even if this method ends up failing and unable to swizzle.
 		// This prevents us from repeatedly attempting a swizzle that won't work.
 		[classInfo->_getters addObject:constructionInfo->_propertyName];
+		[classInfo->_forceValidThunks addObject:[NSNull null]];
 		constructionInfo->_classToModify = classInfo->_shadowClass;
 
-		// Get the index of the property. If the index is larger than the # of bits in the bitfield,
-		// no point in swizzling as we can't record validity.
+		// Get the index of the property. Indexes past the inline bitfield record validity in overflow chunks.
 		constructionInfo->_propertyIndex = [classInfo->_getters indexOfObject:constructionInfo->_propertyName];
-		if ((constructionInfo->_propertyIndex >= numProperties || constructionInfo->_propertyIndex == NSNotFound) &&
-				!constructionInfo->_loader)
+		if (constructionInfo->_propertyIndex == NSNotFound && !constructionInfo->_loader)
 			return NO;
 	}
 
@@ -888,6 +1259,14 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 */
 - (NSString *) ebn_propertyNameAtIndex:(NSInteger) index
 {
+	if (class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
+	{
+		// Registered classes have a frozen copy of the getters, which doesn't need the sync
+		EBNShadowedClassInfo *info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
+		if (info && info->_frozenGetters && index < (NSInteger) info->_frozenGetters.count)
+			return info->_frozenGetters[index];
+	}
+	
 	@synchronized (EBNBaseClassToShadowInfoTable)
 	{
 		if (class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
@@ -907,28 +1286,38 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 }
 
 /****************************************************************************************************
-	ebn_indexOfProperty:
+	ebn_indexOfProperty:inlineBitCount:
 	
 	The list of overridden getters in a ShadowedClassInfo object is in a NSOrderedSet, and this
 	method takes the name of an overridden property and returns its index in that set. This index matches
 	the bit index into the currentlyVaidProperties bitfield that says whether this property is 
-	currently valid or not.
+	currently valid or not. Also returns the size of the inline part of the bitfield, for EBNValidityWord().
 */
-- (NSInteger) ebn_indexOfProperty:(NSString *) propName
+- (NSInteger) ebn_indexOfProperty:(NSString *) propName inlineBitCount:(NSInteger *) inlineBitCount
 {
 	if (!class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
 	{
 		return NSNotFound;
 	}
 	
+	// Registered classes have a frozen index table, which doesn't need the sync
+	EBNShadowedClassInfo *info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
+	if (info && info->_frozenPropertyIndexes)
+	{
+		NSNumber *propIndex = info->_frozenPropertyIndexes[propName];
+		if (!propIndex)
+			return NSNotFound;
+		
+		*inlineBitCount = info->_validPropertyBitfieldSize;
+		return [propIndex integerValue];
+	}
+	
 	@synchronized (EBNBaseClassToShadowInfoTable)
 	{
-		EBNShadowedClassInfo *info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
-		if (info)
+		if (info && info->_validPropertyBitfieldSize != NSNotFound)
 		{
-			NSInteger index = [info->_getters indexOfObject:propName];
-			if (index < info->_validPropertyBitfieldSize)
-				return index;
+			*inlineBitCount = info->_validPropertyBitfieldSize;
+			return [info->_getters indexOfObject:propName];
 		}
 	}
 	
@@ -953,6 +1342,26 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	return nil;
 }
 
+/****************************************************************************************************
+	ebn_freeValidityOverflow
+	
+	Frees any overflow chunks of the receiver's validity bitfield. Called from dealloc.
+*/
+- (void) ebn_freeValidityOverflow
+{
+	ValidPropertiesStruct *validProperties = self.ebn_currentlyValidProperties;
+	if (!validProperties)
+		return;
+	
+	EBNValidityOverflowChunk *chunk = validProperties->overflow.exchange(nullptr);
+	while (chunk)
+	{
+		EBNValidityOverflowChunk *nextChunk = chunk->next.load();
+		delete chunk;
+		chunk = nextChunk;
+	}
+}
+
 /****************************************************************************************************
 	ebn_markPropertyValid:
 	
@@ -964,17 +1373,12 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 */
 - (void) ebn_markPropertyValid:(NSString *) property
 {
-	// Get the index of the property
-	NSInteger propIndex = [self ebn_indexOfProperty:property];
-	if (propIndex != NSNotFound)
-	{
-		ValidPropertiesStruct *validProperties = [self ebn_currentlyValidProperties];
-		if (validProperties)
-		{
-			std::atomic_fetch_or(validProperties->propertyBitfield + propIndex / 32, 
-					(uint32_t) (1 << (propIndex & 31)));
-		}
-	}
+	if (!class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
+		return;
+	
+	EBNShadowedClassInfo *info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
+	if (info)
+		EBNMarkPropertyValid(self, info, NSNotFound, property);
 }
 
 /****************************************************************************************************
@@ -983,14 +1387,29 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
  	Forces the given property into its valid state. The method does this by calling the getter on the
 	property.
 	
-	If speed is *really* an issue with this method, we could probably make a template to fix this.
+	Keypath observations call this for each endpoint they attach to, so it's speed-sensitive. Getters
+	overridden by overrideGetterMethod<T>() come with a typed thunk that calls the getter; we only build
+	an NSInvocation for properties that don't have one.
 */
 - (void) ebn_forcePropertyValid:(NSString *) property
 {
 	// Check whether this property is lazy-loaded; return directly if it isn't.
-	NSInteger propIndex = [self ebn_indexOfProperty:property];
+	NSInteger inlineBitCount = 0;
+	NSInteger propIndex = [self ebn_indexOfProperty:property inlineBitCount:&inlineBitCount];
 	if (propIndex == NSNotFound)
 		return;
+	
+	EBNShadowedClassInfo *info = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo];
+	NSArray *forceValidThunks = info->_frozenForceValidThunks;
+	if (propIndex < (NSInteger) forceValidThunks.count)
+	{
+		id forceValid = forceValidThunks[propIndex];
+		if (forceValid != [NSNull null])
+		{
+			((EBNForceValidThunk) forceValid)(self);
+			return;
+		}
+	}
 		
 // These if 0 statements are here to be informative, not deadcode.
 #if 0
@@ -1009,7 +1428,7 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	((void (*)(id, SEL))getterMethod)(self, getterSelector);
 #endif
 
-	// Use NSInvocation to run the getter method.
+	// No thunk; use NSInvocation to run the getter method.
 	SEL getterSelector = ebn_selectorForPropertyGetter([self class], property);
 	if (getterSelector)
 	{
@@ -1090,17 +1509,16 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	NSMutableSet *resultSet = [[NSMutableSet alloc] init];
 	ValidPropertiesStruct *validProperties = self.ebn_currentlyValidProperties;
 
-	for (NSUInteger longIndex = 0; longIndex < (info->_validPropertyBitfieldSize + 31) / 32; longIndex++)
+	EBNForEachValidityWord(validProperties, info->_validPropertyBitfieldSize, [&](uint32_t bitfield, NSInteger firstBitIndex)
 	{
-		uint32_t bitfield = validProperties->propertyBitfield[longIndex];
-		for (int bitIndex = 0; bitIndex < 32; ++bitIndex)
+		for (int bitIndex = 0; bitfield && bitIndex < 32; ++bitIndex)
 		{
 			if (bitfield & (1 << bitIndex))
 			{
-				[resultSet addObject:[self ebn_propertyNameAtIndex:longIndex * 32 + bitIndex]];
+				[resultSet addObject:[self ebn_propertyNameAtIndex:firstBitIndex + bitIndex]];
 			}
 		}
-	}
+	});
 	
 	return [resultSet copy];
 }
@@ -1205,8 +1623,104 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 #pragma mark -
 #pragma mark Template Get Override Functions
 
-// This mutex forces ordered accesses to our private ivar getters and setters.
-static pthread_mutex_t EBN_GetSetMutex = PTHREAD_MUTEX_INITIALIZER;
+/**
+	Aligned ivars of 8 bytes or less are accessed with atomics. Larger ivars (CGSize, CGRect, and so on) are
+	guarded by seqlocks: readers copy the value without locking, and retry if a writer was active. The seqlocks
+	are striped by ivar address, so threads using unrelated properties mostly don't share a lock.
+	
+	16 byte ivars use the seqlocks even where the CPU has 16 byte atomics; on ARM those atomic loads are
+	exclusive load/store pairs, which write the cache line and so make readers contend with each other.
+	
+	Writers serialize on their stripe's mutex. Readers that keep seeing a write in progress (a writer got
+	preempted mid-write, say) fall back to the mutex, so that they block instead of spinning.
+*/
+struct alignas(64) EBNIvarStripe
+{
+	pthread_mutex_t			_writeLock = PTHREAD_MUTEX_INITIALIZER;
+	std::atomic<uint32_t>	_sequence;
+};
+
+static const uintptr_t		kEBNIvarStripeCount = 32;
+static const int			kEBNSeqlockReadAttempts = 8;
+static EBNIvarStripe		EBNIvarStripes[kEBNIvarStripeCount];
+
+/****************************************************************************************************
+	EBNIvarStripeForAddress()
+	
+*/
+static inline EBNIvarStripe &EBNIvarStripeForAddress(const void *ivarPtr)
+{
+	return EBNIvarStripes[((uintptr_t) ivarPtr >> 4) % kEBNIvarStripeCount];
+}
+
+/****************************************************************************************************
+	EBNIvarAccess
+	
+	Loads and stores ivars of type T. The general template uses the seqlocks; the specialization for types
+	the platform can access atomically uses atomics, as long as the ivar is aligned to its size.
+*/
+template<typename T, bool isLockFree = (sizeof(T) <= 8 && __atomic_always_lock_free(sizeof(T), 0))> struct EBNIvarAccess
+{
+	static inline T load(T *ivarPtr)
+	{
+		EBNIvarStripe &stripe = EBNIvarStripeForAddress(ivarPtr);
+		T localValue;
+		for (int attempt = 0; attempt < kEBNSeqlockReadAttempts; ++attempt)
+		{
+			uint32_t sequence = stripe._sequence.load(std::memory_order_acquire);
+			if (sequence & 1)
+				continue;
+			
+			memcpy(&localValue, ivarPtr, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (stripe._sequence.load(std::memory_order_relaxed) == sequence)
+				return localValue;
+		}
+		
+		// Writers keep beating us; wait for the current one to finish
+		pthread_mutex_lock(&stripe._writeLock);
+		localValue = *ivarPtr;
+		pthread_mutex_unlock(&stripe._writeLock);
+		return localValue;
+	}
+	
+	static inline void store(T *ivarPtr, T value)
+	{
+		EBNIvarStripe &stripe = EBNIvarStripeForAddress(ivarPtr);
+		pthread_mutex_lock(&stripe._writeLock);
+		stripe._sequence.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		*ivarPtr = value;
+		stripe._sequence.fetch_add(1, std::memory_order_release);
+		pthread_mutex_unlock(&stripe._writeLock);
+	}
+};
+
+template<typename T> struct EBNIvarAccess<T, true>
+{
+	static inline bool isAligned(T *ivarPtr)
+	{
+		return ((uintptr_t) ivarPtr & (sizeof(T) - 1)) == 0;
+	}
+	
+	static inline T load(T *ivarPtr)
+	{
+		if (!isAligned(ivarPtr))
+			return EBNIvarAccess<T, false>::load(ivarPtr);
+		
+		T localValue;
+		__atomic_load(ivarPtr, &localValue, __ATOMIC_ACQUIRE);
+		return localValue;
+	}
+	
+	static inline void store(T *ivarPtr, T value)
+	{
+		if (!isAligned(ivarPtr))
+			return EBNIvarAccess<T, false>::store(ivarPtr, value);
+		
+		__atomic_store(ivarPtr, &value, __ATOMIC_RELEASE);
+	}
+};
 
 /****************************************************************************************************
 	EBNGetIvar
@@ -1217,26 +1731,14 @@ static pthread_mutex_t EBN_GetSetMutex = PTHREAD_MUTEX_INITIALIZER;
 	object-valued properties.
 	
 	There are several specializations to this template method. Object-valued properties have a specialization
-	for ARC that uses object_getIvar(). Primitive types that have naturally atomic loads and stores have 
-	specializations for performace reasons (the lock is time consuming and not necessary).
+	for ARC that uses object_getIvar(). Everything else goes through EBNIvarAccess, which uses atomics where
+	the platform has them for the type's size, and seqlocks otherwise.
 */
 template<typename T> static inline T EBNGetIvar(NSObject *blockSelf, ptrdiff_t ivarOffset, Ivar getterIvar)
 {
 	// Yes--we need all 3 casts. 
 	T *ivarPtr = (T *) (((char *) ((__bridge void *) blockSelf)) + ivarOffset);
-	
-	// For ivars that can't be read atomically (size is > 4), use the lock
-	// NOTE: a smart compiler may be able to optimize away the if statement
-	if (sizeof(T) > 4)
-	{
-		// Lock for threading, get the value from the ivar, unlock
-		pthread_mutex_lock(&EBN_GetSetMutex);
-		T localValue = *ivarPtr;
-		pthread_mutex_unlock(&EBN_GetSetMutex);
-		return localValue;
-	}
-	
-	return *ivarPtr;
+	return EBNIvarAccess<T>::load(ivarPtr);
 }
 template<> inline id EBNGetIvar<id>(NSObject *blockSelf, ptrdiff_t ivarOffset, Ivar getterIvar)
 {
@@ -1261,19 +1763,7 @@ template<typename T> static inline void EBNSetIvar(NSObject *blockSelf, ptrdiff_
 {
 	// Get a pointer to the value we need to set. Yes we need all 3 casts.
 	T *ivarPtr = (T *) (((char *) ((__bridge void *) blockSelf)) + ivarOffset);
-
-	// For ivars that can't be written atomically (size is > 4), use the lock
-	// NOTE: a smart compiler may be able to optimize away the if statement
-	if (sizeof(T) > 4)
-	{
-		pthread_mutex_lock(&EBN_GetSetMutex);
-		*ivarPtr = value;
-		pthread_mutex_unlock(&EBN_GetSetMutex);
-	}
-	else
-	{
-		*ivarPtr = value;
-	}
+	EBNIvarAccess<T>::store(ivarPtr, value);
 }
 
 template<> inline void EBNSetIvar<id>(NSObject *blockSelf, ptrdiff_t ivarOffset,
@@ -1369,6 +1859,86 @@ template<> inline void EBNPrivateIvarObjectFixer<id>(LazyLoaderConstructionInfo
 }
 
 
+/**
+	Each thread gets a bitfield with a bit for each overridden getter that has a loader. The bit is set while
+	the thread is inside that getter's loader. It's kept in thread-specific storage instead of the thread
+	dictionary, so that checking it doesn't call into Foundation.
+*/
+struct EBNInsideLoaderBits
+{
+	std::vector<uint32_t>	_words;
+};
+
+static pthread_key_t		EBNInsideLoaderKey;
+
+/****************************************************************************************************
+	EBNDeleteInsideLoaderBits()
+	
+	Thread-specific storage destructor for inside-loader bitfields.
+*/
+static void EBNDeleteInsideLoaderBits(void *bits)
+{
+	delete (EBNInsideLoaderBits *) bits;
+}
+
+/****************************************************************************************************
+	EBNSetupInsideLoaderKey()
+	
+	Called when overriding a getter that has a loader, so that getters don't have to check that the key exists.
+*/
+static void EBNSetupInsideLoaderKey(void)
+{
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken,
+	^{
+		pthread_key_create(&EBNInsideLoaderKey, EBNDeleteInsideLoaderBits);
+	});
+}
+
+/****************************************************************************************************
+	EBNInsideLoaderBitsForCurrentThread()
+	
+	Returns the current thread's bitfield, creating it or growing it so that it has a bit for blockCreationIndex.
+*/
+static inline EBNInsideLoaderBits *EBNInsideLoaderBitsForCurrentThread(uint32_t blockCreationIndex)
+{
+	EBNInsideLoaderBits *bits = (EBNInsideLoaderBits *) pthread_getspecific(EBNInsideLoaderKey);
+	if (!bits)
+	{
+		bits = new EBNInsideLoaderBits();
+		pthread_setspecific(EBNInsideLoaderKey, bits);
+	}
+	
+	if (bits->_words.size() <= blockCreationIndex / 32)
+		bits->_words.resize(blockCreationIndex / 32 + 1);
+	return bits;
+}
+
+/**
+	Sets a getter's bit in the thread's bitfield for as long as the guard is in scope, including when the loader
+	throws. Always goes through the vector, since a recursive call for a newer getter can grow it.
+*/
+class EBNInsideLoaderGuard
+{
+public:
+	EBNInsideLoaderGuard(EBNInsideLoaderBits *bits, uint32_t blockCreationIndex, uint32_t bitMask) :
+			_bits(bits), _wordIndex(blockCreationIndex / 32), _bitMask(bitMask)
+	{
+		_bits->_words[_wordIndex] |= _bitMask;
+	}
+	
+	~EBNInsideLoaderGuard()
+	{
+		_bits->_words[_wordIndex] &= ~_bitMask;
+	}
+
+private:
+	EBNInsideLoaderBits		*_bits;
+	uint32_t				_wordIndex;
+	uint32_t				_bitMask;
+};
+
+
 /****************************************************************************************************
 	template <T> overrideGetterMethod()
 	
@@ -1415,6 +1985,7 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 		sBlockCreationIndex++;
 		IMP loaderIMP = [constructionInfo->_classToModify instanceMethodForSelector:constructionInfo->_loader];
 		loaderFunc = (void (*)(id, SEL, NSString *)) loaderIMP;
+		EBNSetupInsideLoaderKey();
 	}
 	uint32_t longBitMask = 1 << (blockCreationIndex & 31);
 	
@@ -1423,6 +1994,8 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	T (*originalGetter)(id, SEL) = (T (*)(id, SEL)) method_getImplementation(constructionInfo->_getterMethod);
 	SEL getterSEL = method_getName(constructionInfo->_getterMethod);
 	NSInteger propertyIndex = constructionInfo->_propertyIndex;
+	NSInteger inlineBitCount = constructionInfo->_classInfo->_validPropertyBitfieldSize;
+	uint32_t propertyBitMask = (uint32_t) (1 << (propertyIndex & 31));
 	SEL loader = constructionInfo->_loader;
 	NSString *propName = constructionInfo->_propertyName;
 	SEL copyFromSEL = constructionInfo->_copyFromSEL;
@@ -1454,10 +2027,11 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 		ValidPropertiesStruct *validProperties = blockSelf.ebn_currentlyValidProperties;
 		
 		// If the property is valid, just get the ivar and return it--we're done.
-		if (propertyIndex != NSNotFound &&
-				(validProperties->propertyBitfield[propertyIndex / 32] & (1 << (propertyIndex & 31))) != 0)
+		if (validProperties && propertyIndex != NSNotFound)
 		{
-			return EBNGetIvar<T>(blockSelf, ivarOffset, getterIvar);
+			std::atomic<uint32_t> *bitfieldWord = EBNValidityWord(validProperties, inlineBitCount, propertyIndex, false);
+			if (bitfieldWord && (bitfieldWord->load() & propertyBitMask) != 0)
+				return EBNGetIvar<T>(blockSelf, ivarOffset, getterIvar);
 		}
 		
 		// The optional loader method is called with a property name and is responsible for
@@ -1472,51 +2046,23 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 			//		• Per Getter We've Overridden
 			// It is *not* per object. If a loader func for Object A gets a property from Object B (of the same class)
 			// the property loader for B will be bypassed due to this recursion check.
-			NSMutableDictionary *threadDict = [[NSThread currentThread ]threadDictionary];
-			if (threadDict)
+			EBNInsideLoaderBits *insideLoaderBits = EBNInsideLoaderBitsForCurrentThread(blockCreationIndex);
+			
+			// If our bit is already set, the loader is calling itself recursively; prevent this
+			if (!(insideLoaderBits->_words[blockCreationIndex / 32] & longBitMask))
 			{
-				// Each thread gets one of these mutableDatas in their thread dict. Create it if it's not there.
-				NSMutableData *insideLoaderData = [threadDict objectForKey:@"EBNLazyLoader_IsInsideLoaderFunc"];
-				if (!insideLoaderData)
-				{
-					insideLoaderData = [[NSMutableData alloc] initWithLength:((sBlockCreationIndex + 31) / 32) * 8];
-					[threadDict setObject:insideLoaderData forKey:@"EBNLazyLoader_IsInsideLoaderFunc"];
-				}
-				
-				// If the insideLoaderData for this thread isn't big enough, expand it so that it is.
-				if (insideLoaderData.length * 8 < blockCreationIndex)
-				{
-					insideLoaderData.length = ((sBlockCreationIndex + 31) / 32) * 8;
-				}
-				
-				// If our bit is already set, the loader is calling itself recursively; prevent this
-				uint32_t *bitfieldLong = ((uint32_t *) [insideLoaderData mutableBytes]) + blockCreationIndex / 32;
-				if (!(*bitfieldLong & longBitMask))
-				{
-					@try
-					{
-						*bitfieldLong |= longBitMask;
-					
-						// Call the loader. Even if the loader throws we've got to remove ourselves from
-						// the performingLoads set, else we will break property access in this thread.
-						loaderFunc(blockSelf, loader, propName);
-					}
-					@finally
-					{
-						// Other threads can't mutate our thread's insideLoaderData, but recursion can
-						bitfieldLong = ((uint32_t *) [insideLoaderData mutableBytes]) + blockCreationIndex / 32;
-						*bitfieldLong &= ~longBitMask;
-					}
-				}
-				else
-				{
-					// You got here because we're trying to prevent infinite recursion. But, this means that we
-					// have to return old/invalid values for this property--only for the result of the inner call.
-					// Hence this log notice.
-					EBLogContext(kLoggingContextOther, @"The property loader (%@) for class %@ and property %@ "
-							@"is calling itself recursively.",
-							NSStringFromSelector(loader), [blockSelf class], propName);
-				}
+				// Even if the loader throws, the guard clears our bit, else we would break property access in this thread.
+				EBNInsideLoaderGuard insideLoader(insideLoaderBits, blockCreationIndex, longBitMask);
+				loaderFunc(blockSelf, loader, propName);
+			}
+			else
+			{
+				// You got here because we're trying to prevent infinite recursion. But, this means that we
+				// have to return old/invalid values for this property--only for the result of the inner call.
+				// Hence this log notice.
+				EBLogContext(kLoggingContextOther, @"The property loader (%@) for class %@ and property %@ "
+						@"is calling itself recursively.",
+						NSStringFromSelector(loader), [blockSelf class], propName);
 			}
 		}
 		
@@ -1534,7 +2080,7 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 		// to start returning the ivar directly on future calls).
 		if (validProperties && propertyIndex != NSNotFound)
 		{
-			std::atomic_fetch_or(validProperties->propertyBitfield + propertyIndex / 32, (uint32_t) (1 << (propertyIndex & 31)));
+			EBNValidityWord(validProperties, inlineBitCount, propertyIndex, true)->fetch_or(propertyBitMask);
 		}
 		return value;
 	};
@@ -1543,6 +2089,20 @@ template<typename T> void overrideGetterMethod(LazyLoaderConstructionInfo *const
 	IMP swizzledImplementation = imp_implementationWithBlock(getLazily);
 	class_replaceMethod(constructionInfo->_classToModify, getterSEL, swizzledImplementation,
 			method_getTypeEncoding(constructionInfo->_getterMethod));
+	EBNInvalidateAccessorCache(constructionInfo->_classToModify);
+
+	// ebn_forcePropertyValid: calls this to run the new getter, without having to build an NSInvocation
+	if (propertyIndex != NSNotFound)
+	{
+		EBNForceValidThunk forceValid = ^void (NSObject *blockSelf)
+		{
+			(void) getLazily(blockSelf);
+		};
+		@synchronized (EBNBaseClassToShadowInfoTable)
+		{
+			constructionInfo->_classInfo->_forceValidThunks[propertyIndex] = forceValid;
+		}
+	}
 }
 
 @end
@@ -252,7 +252,8 @@
 	@param keyPath   A period separated string of property names, specifying a series of properties starting from the receiver
 	@param callBlock A block that gets called when the value changes.
 
-	@return An EBNObservation object describing the created observation.
+	@return An EBNObservation object describing the created observation. This is also a handle to the observation;
+			calling stopObservations on it ends exactly this observation, without searching for it.
 */
 - (nullable EBNObservation *) tell:(nonnull id) observer when:(nonnull NSString *) keyPath
 		changes:(nonnull ObservationBlock) callBlock;
@@ -291,6 +292,10 @@
 /**
 	The receiver iterates through all observations rooted on self and active on the given keyPath, 
 	removing any observations whose observer object is equal to observer.
+	
+	For keypaths through array elements, this removes every observation the observer made on that keypath, including 
+	ones that have since followed their array element to another index. To remove just one observation, call 
+	stopObservations or stopObserving: on the EBNObservation returned when the observation was created.
 
 	@param observer     The object that (presumably) registered as an observer in a tell: method.
 	@param keyPath 		The keypath to remove observations from.
@@ -403,6 +408,42 @@
  */
 + (nonnull Class) ebn_properBaseClass;
 
+/**
+	Builds the shadow class for this class and wraps the setters of the given properties, so that the first
+	observation of an object of this class doesn't have to. After this, observing an object of the class only
+	has to isa-swizzle the object. Safe to call from any thread; see EBNPrepareClassesForObservation() for a 
+	way to do this for a set of classes on a background thread at launch.
+	
+	Does nothing for collection classes, for classes that are already runtime subclasses, and for toll-free 
+	bridged classes.
+	
+	@param propertyNames The properties to prepare. Pass nil to prepare every property of the class, which also
+			prepares the class for "*" observations.
+*/
++ (void) ebn_prepareForObservationOfProperties:(nullable NSArray<NSString *> *) propertyNames;
+
+/**
+	Starts a change batch on the current thread. Until the batch is committed, setters of observed properties 
+	that get called on this thread just set the value and note that the property changed, along with the value it had
+	before its first change in the batch. ebn_commitChanges then updates keypaths and calls or schedules observers
+	once for each changed property, as if the property's setter had been called once.
+	
+	Use this when applying lots of changes to observed objects at once, such as updating a model from a server response.
+	
+	Batches nest; only the outermost commit does anything. Batches are per-thread, and don't affect changes made on
+	other threads. Note that immediate observations of properties changed inside a batch don't get called until
+	the batch is committed, and neither do lazy loader invalidations. Reading a lazy property inside a batch after
+	changing a property it depends on may return a stale value.
+*/
++ (void) ebn_beginChanges;
+
+/**
+	Ends a change batch started with ebn_beginChanges. If this is the outermost batch on the current thread, triggers
+	observers for all properties changed during the batch. Properties whose values ended up equal to their value 
+	before the batch don't trigger observers.
+*/
++ (void) ebn_commitChanges;
+
 @end
 
 @interface NSObject (EBNObservableDebugging)
@@ -465,6 +506,87 @@
 
 @end
 
+/**
+	Counters describing the work done running delayed observation blocks at the end of each runloop. A drain
+	runs the blocks that were scheduled before it started, then any blocks those blocks scheduled, and so on;
+	each of these passes is one level of cascade depth. A block runs at most once per drain. If another thread
+	schedules it again after it ran, the next drain runs it again; if the drain's own blocks do, it doesn't.
+	Drains that find nothing scheduled aren't counted.
+*/
+typedef struct
+{
+	NSUInteger		drainCount;			// Drains that ran since the last reset
+	NSUInteger		totalBlocksRun;		// Observation blocks run by all those drains
+	CFTimeInterval	totalDrainTime;		// Wall time spent in all those drains, in seconds
+	NSUInteger		maxCascadeDepth;	// Deepest cascade of any drain
+
+	NSUInteger		lastBlocksRun;		// Observation blocks run by the most recent drain
+	NSUInteger		lastCascadeDepth;	// Cascade depth of the most recent drain
+	CFTimeInterval	lastDrainTime;		// Wall time of the most recent drain, in seconds
+	NSUInteger		lastBlocksCarriedOver;	// Blocks the most recent drain left for the next one, due to the time budget or other threads
+} EBNDrainStatistics;
+
+/**
+	Returns the drain counters. Drains run on the main thread, and so should callers of this method.
+
+	@return The counters accumulated since the last call to EBNResetDrainStatistics().
+*/
+EBNDrainStatistics EBNGetDrainStatistics(void);
+
+/**
+	Zeroes the drain counters.
+*/
+void EBNResetDrainStatistics(void);
+
+/**
+	Sets a time budget for each drain of delayed observation blocks. Once a drain has used up its budget, 
+	it stops running blocks with priority below EBNObservationPriorityVisibleUI and carries them over to the next 
+	runloop pass, so that a large burst of changes gets spread across several passes instead of causing one long hitch.
+	Each drain runs at least one budgeted block, so the backlog always makes progress.
+	
+	Blocks still run at most once per drain; a carried-over block whose properties change again before it runs
+	is only run once.
+	
+	Main thread only. 
+
+	@param budget The budget, in seconds. 0, the default, means drains run every block scheduled.
+*/
+void EBNSetDrainTimeBudget(CFTimeInterval budget);
+
+/**
+	Returns the drain time budget set with EBNSetDrainTimeBudget(). Main thread only.
+*/
+CFTimeInterval EBNGetDrainTimeBudget(void);
+
+/**
+	Returns the number of delayed blocks of the given priority that the last drain carried over because 
+	of the time budget. These will run at the start of the next drain. Main thread only.
+	
+	@param priority The priority to count blocks of.
+
+	@return The number of blocks carried over.
+*/
+NSUInteger EBNGetDrainBacklogCount(EBNObservationPriority priority);
+
+/**
+	Sets the maximum number of threads drains use to run concurrent-safe observation blocks (see 
+	EBNObservation's isConcurrentSafe property). The main thread counts as one of them. Main thread only.
+	
+	@param maxThreads The maximum thread count. 1 runs concurrent-safe blocks on the main thread, like other blocks.
+			0, the default, uses one thread per active processor core.
+*/
+void EBNSetDrainConcurrency(NSUInteger maxThreads);
+
+/**
+	Calls ebn_prepareForObservationOfProperties: with nil for each of the given classes, on a low priority 
+	background queue. Meant to be called at launch, with the model classes the first screens are going to observe,
+	perhaps read from a manifest with NSClassFromString().
+	
+	@param classes		The classes to prepare.
+	@param completion	Called on the main queue once all the classes have been prepared. May be nil.
+*/
+void EBNPrepareClassesForObservation(NSArray<Class> * _Nonnull classes, dispatch_block_t _Nullable completion);
+
 /**
 	A protocol that objects can implement to get notified when their properties get observed.
 */
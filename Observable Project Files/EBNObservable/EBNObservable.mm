@@ -6,6 +6,11 @@
     Copyright (c) 2013-2018 eBay Software Foundation.
 */
 
+#import <atomic>
+#import <unordered_map>
+#import <unordered_set>
+#import <string>
+#import <pthread.h>
 #import <sys/sysctl.h>
 #import <objc/runtime.h>
 #import <objc/message.h>
@@ -47,14 +52,117 @@ static inline id EBNWrapValue(const UIEdgeInsets value)		{ return [NSValue value
 	wraps the result into an Objective-C object. Used by ebn_valueForKey in order to help make a 
 	valueForKey: method that throws fewer exceptions than Apple's.
 */
-template<typename T> id getAndWrapProperty(id self, Method getterMethod, SEL getterSEL)
+template<typename T> id getAndWrapProperty(id self, SEL getterSEL, IMP getterIMP, NSString *key)
 {
-	T (*getterImplementation)(id, SEL) = (T (*)(id, SEL)) method_getImplementation(getterMethod);
+	T (*getterImplementation)(id, SEL) = (T (*)(id, SEL)) getterIMP;
 	T getterResult = getterImplementation(self, getterSEL);
 	id wrappedResult = EBNWrapValue(getterResult);
 	return wrappedResult;
 }
 
+/****************************************************************************************************
+	getPropertyWithValueForKey
+	
+	The getter thunk for return types we don't know how to box ourselves.
+	
+	valueForKey is inside an exception handler because some property types aren't KVC-compliant
+	and throw NSUnknownKeyException when it appears the actual problem is that KVC can't box up the type,
+	as opposed to being unable to find a getter method or ivar. ebn_valueForKey is private to Observable
+	and doesn't care about these exceptions.
+*/
+static id getPropertyWithValueForKey(id self, SEL getterSEL, IMP getterIMP, NSString *key)
+{
+	id result = nil;
+	@try
+	{
+		result = [self valueForKey:key];
+	}
+	@catch (NSException *exception)
+	{
+		// Swallow unknown key exceptions (and warn), rethrow all others
+		if ([exception.name isEqualToString:@"NSUnknownKeyException"])
+		{
+			EBLogContext(kLoggingContextOther, @"Performance Warning: valueForKey threw an NSUnknownKeyException.");
+		}
+		else
+		{
+			@throw exception;
+		}
+	}
+	
+	return result;
+}
+
+/****************************************************************************************************
+	getUnsupportedProperty
+	
+	The getter thunk for return types (bitfields, unknown structs) that can't be boxed.
+*/
+static id getUnsupportedProperty(id self, SEL getterSEL, IMP getterIMP, NSString *key)
+{
+	EBAssert(false, @"Observable does not have a way to override the setter for %@.", key);
+	return nil;
+}
+
+/****************************************************************************************************
+	EBNGetterThunkForMethod()
+	
+	Picks the getter thunk to use for the given getter method, based on its return type. ebn_valueForKey
+	calls the thunk for the getter every time it's called, but only needs to look at the return type once.
+*/
+static EBNGetterThunk EBNGetterThunkForMethod(Method getterMethod)
+{
+	char typeOfGetter[32];
+	method_getReturnType(getterMethod, typeOfGetter, 32);
+
+	switch (typeOfGetter[0])
+	{
+	case _C_CHR:		return getAndWrapProperty<char>;
+	case _C_UCHR:		return getAndWrapProperty<unsigned char>;
+	case _C_SHT:		return getAndWrapProperty<short>;
+	case _C_USHT:		return getAndWrapProperty<unsigned short>;
+	case _C_INT:		return getAndWrapProperty<int>;
+	case _C_UINT:		return getAndWrapProperty<unsigned int>;
+	case _C_LNG:		return getAndWrapProperty<long>;
+	case _C_ULNG:		return getAndWrapProperty<unsigned long>;
+	case _C_LNG_LNG:	return getAndWrapProperty<long long>;
+	case _C_ULNG_LNG:	return getAndWrapProperty<unsigned long long>;
+	case _C_FLT:		return getAndWrapProperty<float>;
+	case _C_DBL:		return getAndWrapProperty<double>;
+	case _C_BOOL:		return getAndWrapProperty<bool>;
+	
+	case _C_BFLD:
+		// Pretty sure this can't happen, as bitfields can't be top-level and are only found inside structs/unions
+		return getUnsupportedProperty;
+		
+	case _C_PTR:
+	case _C_CHARPTR:
+	case _C_ATOM:		// Apparently never generated? Only docs I can find say treat same as charptr
+	case _C_ARY_B:
+		return getAndWrapProperty<void *>;
+	
+	case _C_ID:			return getAndWrapProperty<id>;
+	case _C_CLASS:		return getAndWrapProperty<Class>;
+	case _C_SEL:		return getAndWrapProperty<SEL>;
+
+	case _C_STRUCT_B:
+		if (!strncmp(typeOfGetter, @encode(NSRange), 32))
+			return getAndWrapProperty<NSRange>;
+		else if (!strncmp(typeOfGetter, @encode(CGPoint), 32))
+			return getAndWrapProperty<CGPoint>;
+		else if (!strncmp(typeOfGetter, @encode(CGRect), 32))
+			return getAndWrapProperty<CGRect>;
+		else if (!strncmp(typeOfGetter, @encode(CGSize), 32))
+			return getAndWrapProperty<CGSize>;
+		else if (!strncmp(typeOfGetter, @encode(UIEdgeInsets), 32))
+			return getAndWrapProperty<UIEdgeInsets>;
+		return getUnsupportedProperty;
+			
+	default:
+		return getPropertyWithValueForKey;
+	}
+}
+
 // When we create a shadowed subclass we'll add these functions as methods of the new subclass
 static void EBNOverrideDeallocForClass(Class shadowClass);
 static void ebn_shadowed_dealloc(__unsafe_unretained NSObject *self, SEL _cmd);
@@ -72,23 +180,41 @@ extern "C"
 }
 
 BOOL EBNComparePropertyAtIndex(NSInteger index, EBNKeypathEntryInfo *info, NSString *propName, id prevObject, id curObject);
+static void EBNTriggerObservers(NSObject *observedObject, id prevValue, id newValue, const EBNObserverSnapshot &observers);
+
 template<typename T> inline BOOL EBNComparePropertyEquality(NSString *propName,
 		NSInteger index, EBNKeypathEntryInfo *info, id prevObject, id curObject);
 
+// Change batches; see ebn_beginChanges
+struct EBNChangeBatch;
+static EBNChangeBatch *EBNCurrentChangeBatch(bool createIfNone);
+static bool EBNChangeBatchAddProperty(EBNChangeBatch *batch, NSObject *object, NSString *propName,
+		id (^getPreviousValue)(void), bool isObjectValued);
+static void EBNCommitChangeBatch(EBNChangeBatch *batch);
+
 
-	// Keeping track of delayed blocks
-NSMutableSet					*EBN_ObserverBlocksToRunAfterThisEvent;
-NSMutableSet					*EBN_ObserverBlocksBeingDrained;
-NSMutableArray					*EBN_ObservedObjectKeepAlive;
+	// Keeps observed objects alive while their delayed blocks are being run. Blocks waiting to run are in the schedule queue.
 NSMutableArray 					*EBN_ObservedObjectBeingDrainedKeepAlive;
 
+	// Stamps observations with the drain that ran them, and counts what drains do. Main thread only.
+static NSUInteger				EBNDrainCounter;
+static EBNDrainStatistics		EBNCurrentDrainStatistics;
+
+	// Blocks that drains couldn't fit in their time budget, one list per priority lane, and the
+	// observed objects they need kept alive until they run. Main thread only.
+static const NSUInteger			kEBNPriorityLaneCount = 3;
+static const NSUInteger			kEBNMaxCascadeDepth = 32;
+static std::vector<EBNObservation *> EBNDrainBacklog[kEBNPriorityLaneCount];
+static NSMutableArray			*EBNDrainBacklogKeepAlive;
+static CFTimeInterval			EBNDrainTimeBudget;
+static NSUInteger				EBNDrainConcurrency;
+
 	// Shadow classes--private subclasses that we create to implement overriding setter methods
 	// This dictionary holds EBNShadowedClassInfo objects, and is keyed with Class objects
 NSMapTable						*EBNBaseClassToShadowInfoTable;
 
-	// Not used for anything other than as a @synchronize token. Currently is a pointer alias to
-	// EBN_ObserverBlocksToRunAfterThisEvent, but that could change.
-NSMutableSet					*EBNObservableSynchronizationToken;
+	// Not used for anything other than as a @synchronize token.
+NSObject						*EBNObservableSynchronizationToken;
 
 	// Returned by ebn_ValueForKey: when the receiver doesn't contain a property matching key.
 NSObject						*EBN_InvalidPropertyKey;
@@ -110,7 +236,9 @@ NSObject						*EBN_InvalidPropertyKey;
 		_shadowClass = newShadowClass;
 		_getters = [[NSMutableOrderedSet alloc] init];
 		_setters = [[NSMutableSet alloc] init];
+		_forceValidThunks = [[NSMutableArray alloc] init];
 		_validPropertyBitfieldSize = NSNotFound;		
+		_propertySlots = [[EBNPropertySlotMap alloc] init];
 	}
 	return self;
 }
@@ -173,13 +301,15 @@ NSObject						*EBN_InvalidPropertyKey;
 	
 	Usually this is one observation block, as this method is usally the 'remove one KVO observation' call.
 	But there can be multiple blocks registered by the same observer to view the same keypath, and 
-	deregistering observations is ALWAYS done by searching for observations that match criteria.
+	deregistering observations is ALWAYS done by searching for observations that match criteria. The search
+	only covers the observer's own observations, using the reverse index.
 */
 - (void) stopTelling:(id) observer aboutChangesTo:(NSString *) keyPathStr
 {
-	NSArray *keyPath = [keyPathStr componentsSeparatedByString:@"."];
-	NSString *propName = keyPath[0];
-	NSMutableSet *entriesToRemove = [[NSMutableSet alloc] init];
+	// If the keypath was never interned, nobody could have observed it
+	EBNKeypath *keyPath = [EBNKeypath existingKeypathForString:keyPathStr];
+	if (!keyPath)
+		return;
 	
 	// Look for the case where we're removing 'object-following' array elements. This case
 	// doesn't yet work well. Although we track the original array element that was observed and can find the
@@ -188,7 +318,7 @@ NSObject						*EBN_InvalidPropertyKey;
 	// on it at "array.0". Array elements 0...n will then all have observations on them, with their original
 	// observation keypath set to "array.0" but their current path equal to their current array position.
 	// Calling this method to stop observing on "array.0" will remove all of those observations.
-	for (NSString *pathEntry in keyPath)
+	for (NSString *pathEntry in keyPath->_components)
 	{
 		if (isdigit([pathEntry characterAtIndex:0]))
 		{
@@ -198,32 +328,14 @@ NSObject						*EBN_InvalidPropertyKey;
 		}
 	}
 	
-	// Find all the entries to be removed
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+	// Find the observer's observations rooted at self, and have them remove any keypaths that match
+	for (EBNObservation *observation in [EBNObservation ebn_observationsForObserver:observer])
 	{
-		@synchronized(observedKeysDict)
+		if (observation->_weakObserved == self && !observation.isForLazyLoader)
 		{
-			NSMutableArray *observations = observedKeysDict[propName];
-			for (EBNKeypathEntryInfo *entry in observations)
-			{
-				if (entry->_blockInfo->_weakObserver_forComparisonOnly == observer &&
-						entry->_keyPathIndex == 0 &&
-						!entry->_blockInfo.isForLazyLoader &&
-						[keyPath isEqualToArray:entry->_keyPath])
-				{
-					// We've found the right entry. Add it to the list to be removed.
-					[entriesToRemove addObject:entry];
-				}
-			}
+			[observation ebn_stopObservingKeypath:keyPath];
 		}
 	}
-	
-	// And then remove them
-	for (EBNKeypathEntryInfo *entry in entriesToRemove)
-	{
-		[entry ebn_updateKeypathAtIndex:0 from:self to:nil];
-	}
 }
 
 /****************************************************************************************************
@@ -257,42 +369,22 @@ NSObject						*EBN_InvalidPropertyKey;
 	This removes all observations for the observed-observer pair, no matter the keypath.
 	
 	Deregistering observations is ALWAYS done by searching for observations that match criteria, and all
-	observations that match the given criteria will be removed.
+	observations that match the given criteria will be removed. The search only covers the observer's own 
+	observations, using the reverse index, so this doesn't get slower as self gets more observers.
 */
 - (void) stopTellingAboutChanges:(id) observer
 {
-	int removedBlockCount = 0;
-	NSMutableSet *entriesToRemove = [[NSMutableSet alloc] init];
+	NSUInteger removedBlockCount = 0;
 
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+	// Only look at the observer's observations, not everything observing self
+	for (EBNObservation *observation in [EBNObservation ebn_observationsForObserver:observer])
 	{
-		@synchronized(observedKeysDict)
+		if (observation->_weakObserved == self && !observation.isForLazyLoader)
 		{
-			for (NSString *propertyKey in [observedKeysDict allKeys])
-			{
-				NSMutableArray *observers = observedKeysDict[propertyKey];
-				
-				for (EBNKeypathEntryInfo *entryInfo in observers)
-				{
-					// We're only looking for the blocks for which this is the observed object.
-					if (entryInfo->_blockInfo->_weakObserver_forComparisonOnly == observer &&
-							entryInfo->_keyPathIndex == 0 &&
-							!entryInfo->_blockInfo.isForLazyLoader)
-					{
-						[entriesToRemove addObject:entryInfo];
-						++removedBlockCount;
-					}
-				}
-			}
+			removedBlockCount += [observation ebn_stopObservingKeypath:nil];
 		}
 	}
 
-	for (EBNKeypathEntryInfo *entryInfo in entriesToRemove)
-	{
-		[entryInfo ebn_updateKeypathAtIndex:0 from:self to:nil];
-	}
-
 	// Show warnings for odd results
 	if (removedBlockCount == 0)
 	{
@@ -324,34 +416,28 @@ NSObject						*EBN_InvalidPropertyKey;
 	if (!stopBlock)
 		return;
 
-	int removedBlockCount = 0;
-	NSMutableSet *entriesToRemove = [[NSMutableSet alloc] init];
+	NSUInteger removedBlockCount = 0;
+	NSMutableSet *observationsToStop = [[NSMutableSet alloc] init];
 
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+	// There's no observer to index on here, so look through the table for the observations that run the
+	// indicated block, and then have each of them stop their keypaths.
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	for (NSString *propertyKey in [observationTable allKeys])
 	{
-		@synchronized(observedKeysDict)
+		NSArray *observers = [observationTable entriesForKey:propertyKey];
+		
+		for (EBNKeypathEntryInfo *entryInfo in observers)
 		{
-			for (NSString *propertyKey in [observedKeysDict allKeys])
+			if (entryInfo->_blockInfo->_copiedBlock == stopBlock && entryInfo->_keyPathIndex == 0)
 			{
-				NSMutableArray *observers = observedKeysDict[propertyKey];
-				
-				for (EBNKeypathEntryInfo *entryInfo in observers)
-				{
-					// Match on the entries where the block that gets run is the indicated block
-					if (entryInfo->_blockInfo->_copiedBlock == stopBlock && entryInfo->_keyPathIndex == 0)
-					{
-						[entriesToRemove addObject:entryInfo];
-						++removedBlockCount;
-					}
-				}
+				[observationsToStop addObject:entryInfo->_blockInfo];
 			}
 		}
 	}
 	
-	for (EBNKeypathEntryInfo *entryInfo in entriesToRemove)
+	for (EBNObservation *observation in observationsToStop)
 	{
-		[entryInfo ebn_updateKeypathAtIndex:0 from:self to:nil];
+		removedBlockCount += [observation ebn_stopObservingKeypath:nil];
 	}
 
 	// Show warnings for odd results
@@ -391,6 +477,80 @@ NSObject						*EBN_InvalidPropertyKey;
 	return self;
 }
 
+/****************************************************************************************************
+	ebn_prepareForObservationOfProperties:
+	
+	Does the class-level work that ebn_swizzleImplementationForSetter: would do on first observation. Each
+	property is swizzled in its own sync, so that a main thread observing objects while this runs
+	in the background doesn't wait for the whole class.
+*/
++ (void) ebn_prepareForObservationOfProperties:(NSArray<NSString *> *) propertyNames
+{
+	// Collections wrap their mutators when their objects get observed, and runtime subclasses (ours or Apple's KVO)
+	// are handled when their objects get observed.
+	if ([self isSubclassOfClass:[NSArray class]] || [self isSubclassOfClass:[NSDictionary class]] ||
+			[self isSubclassOfClass:[NSSet class]] || class_respondsToSelector(self, @selector(ebn_shadowClassInfo)) ||
+			self != [self ebn_properBaseClass])
+		return;
+
+	NSSet *allProperties = EBNAllPropertiesForClass(self);
+	if (!allProperties.count)
+		return;
+	
+	EBNShadowedClassInfo *info = nil;
+	@synchronized (EBNBaseClassToShadowInfoTable)
+	{
+		info = [NSObject ebn_createShadowedSubclass:self actualClass:self additionalOverrides:NO];
+		if (!info || info->_allSettersSwizzled)
+			return;
+	}
+	
+	for (NSString *propName in propertyNames ? propertyNames : allProperties)
+	{
+		if (![allProperties containsObject:propName])
+			continue;
+		
+		@synchronized (EBNBaseClassToShadowInfoTable)
+		{
+			[info->_shadowClass ebn_swizzleImplementationForSetter:propName info:info];
+		}
+	}
+	
+	if (!propertyNames)
+	{
+		@synchronized (EBNBaseClassToShadowInfoTable)
+		{
+			info->_allSettersSwizzled = YES;
+		}
+	}
+}
+
+/****************************************************************************************************
+	ebn_beginChanges
+	
+	Starts (or nests) a change batch on the current thread.
+*/
++ (void) ebn_beginChanges
+{
+	EBNCurrentChangeBatch(true)->_depth++;
+}
+
+/****************************************************************************************************
+	ebn_commitChanges
+	
+	Ends a change batch on the current thread. The outermost commit triggers observers.
+*/
++ (void) ebn_commitChanges
+{
+	EBNChangeBatch *batch = EBNCurrentChangeBatch(false);
+	EBAssert(batch && batch->_depth, @"ebn_commitChanges called without a matching ebn_beginChanges.");
+	if (!batch || !batch->_depth)
+		return;
+	
+	if (--batch->_depth == 0)
+		EBNCommitChangeBatch(batch);
+}
+
 #pragma mark Somewhat Protected
 
 /****************************************************************************************************
@@ -443,23 +603,10 @@ NSObject						*EBN_InvalidPropertyKey;
 */
 - (void) ebn_manuallyTriggerObserversForProperty:(NSString *) propertyName previousValue:(id) prevValue
 {
-	NSMutableArray *observers = nil;
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
-	{
-		@synchronized(observedKeysDict)
-		{
-			observers = [observedKeysDict[propertyName] mutableCopy];
-			NSMutableArray *splatObservers = observedKeysDict[@"*"];
-			if (observers && splatObservers)
-				[observers addObjectsFromArray:splatObservers];
-			else if (splatObservers && !observers)
-				observers = [splatObservers copy];				
-		}
-	}
+	EBNObserverSnapshot observers([self ebn_observationTable:NO], propertyName, true);
 	
 	// If nobody's observing, nothing to do
-	if (!observers)
+	if (observers.isEmpty())
 		return;
 	
 	// Execute all the LazyLoader blocks; this handles chained lazy properties--that is, cases where
@@ -468,7 +615,7 @@ NSObject						*EBN_InvalidPropertyKey;
 	
 	size_t numLazyLoaderBlocks = 0;
 	BOOL reapBlocksAfter = NO;
-	for (EBNKeypathEntryInfo *entry in observers)
+	observers.forEachEntry([&](EBNKeypathEntryInfo *entry)
 	{
 		EBNObservation *blockInfo = entry->_blockInfo;
 
@@ -478,7 +625,7 @@ NSObject						*EBN_InvalidPropertyKey;
 				reapBlocksAfter = YES;
 			++numLazyLoaderBlocks;
 		}
-	}
+	});
 	
 	// If there were blocks that couldn't be run because their observing or observed object has gone away,
 	// it's time to reap dead observations.
@@ -486,7 +633,7 @@ NSObject						*EBN_InvalidPropertyKey;
 		[self ebn_reapBlocks];
 	
 	// If that was all the blocks, we're done. Return before we go eval the new value
-	if (observers.count == numLazyLoaderBlocks)
+	if (observers.count() == numLazyLoaderBlocks)
 		return;
 	
 	// If there's observations on the property it's almost always better to eval the new value
@@ -499,8 +646,7 @@ NSObject						*EBN_InvalidPropertyKey;
 	if (newValue == prevValue)
 		return;
 	
-	[self ebn_manuallyTriggerObserversForProperty:propertyName previousValue:prevValue newValue:newValue
-			copiedObserverTable:observers];
+	EBNTriggerObservers(self, prevValue, newValue, observers);
 }
 
 /****************************************************************************************************
@@ -555,87 +701,31 @@ NSObject						*EBN_InvalidPropertyKey;
 		newValue:(id) newValue
 {
 	// Don't test for 'isEqual' here--keypaths need to be updated whenever the pointers are different
-	if (newValue != prevValue || [propertyName isEqualToString:@"*"])
+	BOOL isWildcard = [propertyName isEqualToString:@"*"];
+	if (newValue != prevValue || isWildcard)
 	{
-		NSMutableArray *observers = nil;
-		NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-		if (observedKeysDict)
-		{
-			@synchronized(observedKeysDict)
-			{
-				observers = [observedKeysDict[propertyName] mutableCopy];
-				if (![propertyName isEqualToString:@"*"])
-				{
-					NSMutableArray *splatObservers = observedKeysDict[@"*"];
-					if (observers && splatObservers)
-						[observers addObjectsFromArray:splatObservers];
-					else if (splatObservers && !observers)
-						observers = [splatObservers copy];
-				}
-			}
-		}
+		EBNObserverSnapshot observers([self ebn_observationTable:NO], propertyName, !isWildcard);
 		
 		// If nobody's observing, we're done.
-		if (!observers)
+		if (observers.isEmpty())
 			return;
 		
 		// Execute all the LazyLoader blocks; this handles chained lazy properties--that is, cases where
 		// one lazy property depends on another lazy property. We should do this before calling
 		// immediate blocks, so that an immed block that references a lazy property will force a recompute.
 		
-		size_t numLazyLoaderBlocks = 0;
-		for (EBNKeypathEntryInfo *entry in observers)
+		observers.forEachEntry([&](EBNKeypathEntryInfo *entry)
 		{
 			EBNObservation *blockInfo = entry->_blockInfo;
 
 			if (blockInfo.isForLazyLoader)
 			{
 				[blockInfo executeWithPreviousValue:prevValue];
-				++numLazyLoaderBlocks;
 			}
-		}
-		
-		[self ebn_manuallyTriggerObserversForProperty:propertyName previousValue:prevValue newValue:newValue
-				copiedObserverTable:observers];
-	}
-}
-
-/****************************************************************************************************
-	ebn_manuallyTriggerObserversForProperty:previousValue:newValue:copiedObserverTable:
-	
-	Internal method to trigger observers. Takes a COPY of the observer table (because @sync).
-	The caller should check that the previous and new values aren't equal (using ==) and not call
-	this method if they are, but should not check isEqual: (because of how keypath updating works).
-	
-	This method is private; don't call it directly.
-*/
-- (void) ebn_manuallyTriggerObserversForProperty:(NSString *)propertyName previousValue:(id)prevValue
-		newValue:(id)newValue copiedObserverTable:(NSMutableArray *) observers
-{	
-	BOOL reapBlocksAfter = NO;
-
-	// Go through all the observations, update any keypaths that need it.
-	// If we update a keypath, we'll need to evaluate the property value to get the new value
-	for (EBNKeypathEntryInfo *entry in observers)
-	{
-		// Update the keypath to go through the new object; this also tells us if any endpoint of the keypath
-		// changed value
-		if ([entry ebn_updateNextKeypathEntryFrom:prevValue to:newValue])
-		{
-			EBNObservation *blockInfo = entry->_blockInfo;
-			
-			// We already went through all the lazyloader blocks
-			if (blockInfo.isForLazyLoader)
-				continue;
+		});
 		
-			// Make sure the observed object still exists before calling/scheduling blocks
-			if (![blockInfo executeWithPreviousValue:prevValue])
-				reapBlocksAfter = YES;
-		}
+		EBNTriggerObservers(self, prevValue, newValue, observers);
 	}
-	
-	if (reapBlocksAfter)
-		[self ebn_reapBlocks];
 }
 
 /****************************************************************************************************
@@ -647,19 +737,12 @@ NSObject						*EBN_InvalidPropertyKey;
 {
 	NSUInteger numObservers = 0;
 	
-	// Clean out any observation blocks that are inactive because their observer went away.
-	// We don't want to count them.
-	[self ebn_reapBlocks];
-	
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+	// No need to reap first; observations get removed when their observer deallocs.
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	if (observationTable)
 	{
-		@synchronized(observedKeysDict)
-		{
-			NSMutableArray *observers = observedKeysDict[propertyName];
-			NSMutableArray *splatObservers = observedKeysDict[@"*"];
-			numObservers = observers.count + splatObservers.count;
-		}
+		EBNObserverSnapshot observers(observationTable, propertyName, true);
+		numObservers = observers.count();
 	}
 	
 	return numObservers;
@@ -674,16 +757,11 @@ NSObject						*EBN_InvalidPropertyKey;
 */
 - (NSSet *) allObservedProperties
 {
-	[self ebn_reapBlocks];
-	
 	NSMutableSet *properties = nil;
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	if (observationTable)
 	{
-		@synchronized(observedKeysDict)
-		{
-			properties = [NSMutableSet setWithArray:[observedKeysDict allKeys]];
-		}
+		properties = [NSMutableSet setWithArray:[observationTable allKeys]];
 	}
 	
 	return properties;
@@ -693,39 +771,12 @@ NSObject						*EBN_InvalidPropertyKey;
 	ebn_allProperties
 	
 	Returns all the properties of self, as an array of strings. Includes properties declared in
-	superclasses; properties redefined in subclasses only count once.
+	superclasses; properties redefined in subclasses only count once. Objects of the same class
+	all return the same set.
 */
 - (NSSet *) ebn_allProperties
 {
-	Class curClass = [self class];
-	NSMutableSet *propertySet = [[NSMutableSet alloc] init];
-
-	// copyPropertyList only gives us properties about the current class--not its superclasses.
-	// So, walk up the class tree, from the current class to NSObject.
-	while (curClass && curClass != [NSObject class])
-	{
-		unsigned int propCount;
-		objc_property_t *properties = class_copyPropertyList(curClass, &propCount);
-		if (properties)
-		{
-			for (int propIndex = 0; propIndex < propCount; ++propIndex)
-			{
-				// Get the name of all the properties, add them to the set. We use a set
-				// to deduplicate properties re-declared in subclasses.
-				NSString *propString = @(property_getName(properties[propIndex]));
-				if (propString)
-				{
-					[propertySet addObject:propString];
-				}
-			}
-		
-			free(properties);
-		}
-		
-		curClass = [curClass superclass];
-	}
-	
-	return [propertySet copy];
+	return EBNAllPropertiesForClass([self class]);
 }
 
 #pragma mark Private
@@ -735,8 +786,7 @@ NSObject						*EBN_InvalidPropertyKey;
 	
 	Because static initialization is so great.
 	
-	Sets up a global set of blocks to be run on the main runloop, and creates a run loop observer
-	to iterate the set.
+	Creates a run loop observer to run the blocks that get scheduled each time through the main runloop.
 */
 + (void) load
 {
@@ -748,20 +798,13 @@ NSObject						*EBN_InvalidPropertyKey;
 	static dispatch_once_t once;
 	dispatch_once(&once,
 	^{
-		// Set up our set of blocks to run at the end of each event
-		EBN_ObserverBlocksToRunAfterThisEvent = [[NSMutableSet alloc] init];
+		// Set up the observer that runs scheduled blocks at the end of each event
 		runLoopObserver = CFRunLoopObserverCreate(NULL, kCFRunLoopBeforeWaiting, YES, 0,
 				EBN_RunLoopObserverCallBack, NULL);
 		CFRunLoopAddObserver(CFRunLoopGetMain(), runLoopObserver, kCFRunLoopCommonModes);
 		
-		// EBN_ObserverBlocksToRunAfterThisEvent is created at initialization time, is
-		// never dealloc'ed, and is private to EBNObservable. This makes it a good candidate to use
-		// for our @synchronize token.
-		EBNObservableSynchronizationToken = EBN_ObserverBlocksToRunAfterThisEvent;
-		
-		// And, this is our set of objects to keep from getting dealloc'ed until we can
-		// send their observer messages.
-		EBN_ObservedObjectKeepAlive = [[NSMutableArray alloc] init];
+		// This is created at initialization time, is never dealloc'ed, and is private to EBNObservable.
+		EBNObservableSynchronizationToken = [[NSObject alloc] init];
 
 		// This dictionary contains EBNShadowedClassInfo objects, mapping parent classes
 		// (the observed classes) to the objects with info about the shadow class.
@@ -774,40 +817,41 @@ NSObject						*EBN_InvalidPropertyKey;
 }
 
 /****************************************************************************************************
-	ebn_observedKeysDict:
-	
-	This gets the observed methods dict out of an associated object, creating it if necessary.
+	ebn_observationTable:
 	
-	The caller of this method must be inside a @synchronized() block--keyed off the result of this
-	method--while accessing the dictionary.
+	This gets the observation table out of an associated object, creating it if necessary. Shadow classes
+	created with additional overrides store the table in an ivar instead, and override this method.
 	
-	That is, you need to do this:
-			
-			NSMutableDictionary *dict = [self ebn_observedKeysDict:YES];
-			@synchronized(dict)
-			{
-				... use dict in here
-			}
+	The table does its own synchronization; callers don't need to @synchronize on it. Use the
+	table's methods to mutate it, and use EBNObserverSnapshot to iterate the observers of a property.
 */
-- (NSMutableDictionary *) ebn_observedKeysDict:(BOOL) createIfNil
+- (EBNObservationTable *) ebn_observationTable:(BOOL) createIfNil
 {
-	NSMutableDictionary *observedMethods = objc_getAssociatedObject(self, @selector(ebn_observedKeysDict:));
-	if (!observedMethods && createIfNil)
+	EBNObservationTable *observationTable = objc_getAssociatedObject(self, @selector(ebn_observationTable:));
+	if (!observationTable && createIfNil)
 	{
+		// Tables use the slot map of our shadow class, if we have one. Objects that only get observed
+		// on keys that don't require shadowing ("*" on an object with no properties) get a private map.
+		EBNPropertySlotMap *slotMap = nil;
+		if (class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
+		{
+			slotMap = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo]->_propertySlots;
+		}
+
 		@synchronized(EBNObservableSynchronizationToken)
 		{
 			// Recheck for non-nil inside the sync
-			observedMethods = objc_getAssociatedObject(self, @selector(ebn_observedKeysDict:));
-			if (!observedMethods)
+			observationTable = objc_getAssociatedObject(self, @selector(ebn_observationTable:));
+			if (!observationTable)
 			{
 				// Okay, it really doesn't exist, so set it up while inside the sync
-				observedMethods = [[NSMutableDictionary alloc] init];
-				objc_setAssociatedObject(self, @selector(ebn_observedKeysDict:), observedMethods,
+				observationTable = [[EBNObservationTable alloc] initWithSlotMap:slotMap];
+				objc_setAssociatedObject(self, @selector(ebn_observationTable:), observationTable,
 						OBJC_ASSOCIATION_RETAIN);
 			}
 		}
 	}
-	return observedMethods;
+	return observationTable;
 }
 
 /****************************************************************************************************
@@ -824,133 +868,17 @@ NSObject						*EBN_InvalidPropertyKey;
 */
 - (id) ebn_valueForKey:(NSString *)key
 {
-	id result = nil;
-
-	// valueForKey is inside an exception handler because some property types aren't KVC-compliant
-	// and throw NSUnknownKeyException when it appears the actual problem is that KVC can't box up the type,
-	// as opposed to being unable to find a getter method or ivar. ebn_valueForKey is private to Observable
-	// and doesn't care about these exceptions.
-	@try
-	{
-		// Get the method selector for the getter on this property
-		Class realClass = object_getClass(self);
-		SEL getterSelector = ebn_selectorForPropertyGetter(realClass, key);
-		if (getterSelector)
-		{
-			Method getterMethod = class_getInstanceMethod(realClass, getterSelector);
-			if (getterMethod)
-			{
-				char typeOfGetter[32];
-				method_getReturnType(getterMethod, typeOfGetter, 32);
-
-				switch (typeOfGetter[0])
-				{
-				case _C_CHR:
-					result = getAndWrapProperty<char>(self, getterMethod, getterSelector);
-				break;
-				case _C_UCHR:
-					result = getAndWrapProperty<unsigned char>(self, getterMethod, getterSelector);
-				break;
-				case _C_SHT:
-					result = getAndWrapProperty<short>(self, getterMethod, getterSelector);
-				break;
-				case _C_USHT:
-					result = getAndWrapProperty<unsigned short>(self, getterMethod, getterSelector);
-				break;
-				case _C_INT:
-					result = getAndWrapProperty<int>(self, getterMethod, getterSelector);
-				break;
-				case _C_UINT:
-					result = getAndWrapProperty<unsigned int>(self, getterMethod, getterSelector);
-				break;
-				case _C_LNG:
-					result = getAndWrapProperty<long>(self, getterMethod, getterSelector);
-				break;
-				case _C_ULNG:
-					result = getAndWrapProperty<unsigned long>(self, getterMethod, getterSelector);
-				break;
-				case _C_LNG_LNG:
-					result = getAndWrapProperty<long long>(self, getterMethod, getterSelector);
-				break;
-				case _C_ULNG_LNG:
-					result = getAndWrapProperty<unsigned long long>(self, getterMethod, getterSelector);
-				break;
-				case _C_FLT:
-					result = getAndWrapProperty<float>(self, getterMethod, getterSelector);
-				break;
-				case _C_DBL:
-					result = getAndWrapProperty<double>(self, getterMethod, getterSelector);
-				break;
-				case _C_BFLD:
-					// Pretty sure this can't happen, as bitfields can't be top-level and are only found inside structs/unions
-					EBAssert(false, @"Observable does not have a way to override the setter for %@.", key);
-				break;
-				case _C_BOOL:
-					result = getAndWrapProperty<bool>(self, getterMethod, getterSelector);
-				break;
-				case _C_PTR:
-				case _C_CHARPTR:
-				case _C_ATOM:		// Apparently never generated? Only docs I can find say treat same as charptr
-				case _C_ARY_B:
-					result = getAndWrapProperty<void *>(self, getterMethod, getterSelector);
-				break;
-				
-				case _C_ID:
-					result = getAndWrapProperty<id>(self, getterMethod, getterSelector);
-				break;
-				case _C_CLASS:
-					result = getAndWrapProperty<Class>(self, getterMethod, getterSelector);
-				break;
-				case _C_SEL:
-					result = getAndWrapProperty<SEL>(self, getterMethod, getterSelector);
-				break;
-
-				case _C_STRUCT_B:
-					if (!strncmp(typeOfGetter, @encode(NSRange), 32))
-						result = getAndWrapProperty<NSRange>(self, getterMethod, getterSelector);
-					else if (!strncmp(typeOfGetter, @encode(CGPoint), 32))
-						result = getAndWrapProperty<CGPoint>(self, getterMethod, getterSelector);
-					else if (!strncmp(typeOfGetter, @encode(CGRect), 32))
-						result = getAndWrapProperty<CGRect>(self, getterMethod, getterSelector);
-					else if (!strncmp(typeOfGetter, @encode(CGSize), 32))
-						result = getAndWrapProperty<CGSize>(self, getterMethod, getterSelector);
-					else if (!strncmp(typeOfGetter, @encode(UIEdgeInsets), 32))
-						result = getAndWrapProperty<UIEdgeInsets>(self, getterMethod, getterSelector);
-					else
-						EBAssert(false, @"Observable does not have a way to override the setter for %@.", key);
-				break;
-						
-				default:
-					result = [self valueForKey:key];
-				break;
-				}
-			}
-			else
-			{
-				result = [self valueForKey:key];
-			}
-		}
-		else
-		{
-			// We'd do this here, except it almost never works.
-			// result = [self valueForKey:key];
-			result = nil;
-		}
-	}
-	@catch (NSException *exception)
+	// The getter thunk for this class and key was chosen by the getter's return type when the accessors
+	// were resolved; it calls the getter and boxes the result.
+	EBNPropertyAccessors accessors = EBNAccessorsForProperty(object_getClass(self), key);
+	if (accessors._getterThunk)
 	{
-		// Swallow unknown key exceptions (and warn), rethrow all others
-		if ([exception.name isEqualToString:@"NSUnknownKeyException"])
-		{
-			EBLogContext(kLoggingContextOther, @"Performance Warning: valueForKey threw an NSUnknownKeyException.");
-		}
-		else
-		{
-			@throw exception;
-		}
+		return accessors._getterThunk(self, accessors._getterSEL, accessors._getterIMP, key);
 	}
 	
-	return result;
+	// We'd do this here, except it almost never works.
+	// result = [self valueForKey:key];
+	return nil;
 }
 
 /****************************************************************************************************
@@ -965,13 +893,13 @@ NSObject						*EBN_InvalidPropertyKey;
 	NSString *propName = info->_keyPath[index];
 	if ([propName isEqualToString:@"*"])
 	{
-		// Might be better to use [observedKeysDict allKeys] for the from case
+		// Objects of the same class share their property set; only build a union when the sets differ
 		NSSet *fromPropertySet = [fromObj ebn_allProperties];
 		NSSet *toPropertySet = [toObj ebn_allProperties];
 		NSSet *allProps = fromPropertySet;
 		if (!allProps)
 			allProps = toPropertySet;
-		else
+		else if (toPropertySet && toPropertySet != fromPropertySet)
 			allProps = [fromPropertySet setByAddingObjectsFromSet:toPropertySet];
 			
 		for (NSString *propertyString in allProps)
@@ -998,7 +926,7 @@ NSObject						*EBN_InvalidPropertyKey;
 	// Create our keypath entry
 	EBNKeypathEntryInfo	*entryInfo = [[EBNKeypathEntryInfo alloc] init];
 	entryInfo->_blockInfo = blockInfo;
-	entryInfo->_keyPath = [keyPathString componentsSeparatedByString:@"."];
+	entryInfo->_keyPath = [EBNKeypath keypathForString:keyPathString];
 	entryInfo->_keyPathIndex = 0;
 	
 	return [entryInfo ebn_updateKeypathAtIndex:0 from:nil to:self];
@@ -1015,9 +943,27 @@ NSObject						*EBN_InvalidPropertyKey;
 	
 	if ([propName isEqualToString:@"*"])
 	{
-		for (NSString *expandedPropString in [self ebn_allProperties])
+		// Once a "*" observation has wrapped every property setter of the class, later ones on objects of
+		// the same class don't need to go through each property again. Collections return their keys, not
+		// their class's properties, so they always take the long path.
+		NSSet *allProperties = [self ebn_allProperties];
+		BOOL isClassPropertySet = allProperties == EBNAllPropertiesForClass([self class]);
+		@synchronized (EBNBaseClassToShadowInfoTable)
 		{
-			[self ebn_swizzleImplementationForSetter:expandedPropString];
+			EBNShadowedClassInfo *info = nil;
+			if (isClassPropertySet && allProperties.count)
+				info = [self ebn_prepareObjectForObservation];
+			
+			if (!info || !info->_allSettersSwizzled)
+			{
+				for (NSString *expandedPropString in allProperties)
+				{
+					[self ebn_swizzleImplementationForSetter:expandedPropString];
+				}
+				
+				if (info)
+					info->_allSettersSwizzled = YES;
+			}
 		}
 	}
 	else
@@ -1045,23 +991,18 @@ NSObject						*EBN_InvalidPropertyKey;
 		}
 	}
 
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:YES];
-	@synchronized(observedKeysDict)
+	// Add the entry to the list of things this property is observing. If the table was made while we had some
+	// other class, our class's setters can't trust their slot map's counts to know we're being observed.
+	EBNObservationTable *observationTable = [self ebn_observationTable:YES];
+	if (class_respondsToSelector(object_getClass(self), @selector(ebn_shadowClassInfo)))
 	{
-		// Get the array of blocks to invoke when a particular setter is called.
-		NSMutableArray *observers = observedKeysDict[propName];
-	
-		// If the array doesn't exist, create it and add it to the method dict.
-		if (!observers)
-		{
-			observers = [[NSMutableArray alloc] init];
-			observedKeysDict[propName] = observers;
-			tableWasEmpty = true;
-		}
-		
-		// Add the entry to the list of things this property is observing
-		[observers addObject:entryInfo];
+		EBNPropertySlotMap *classSlotMap = [(NSObject<EBNObservable_Custom_Selectors> *) self ebn_shadowClassInfo]->_propertySlots;
+		if (observationTable.slotMap != classSlotMap)
+			[classSlotMap noteForeignTable];
 	}
+	tableWasEmpty = [observationTable addEntry:entryInfo forKey:propName];
+	if (entryInfo->_keyPathIndex == 0)
+		[entryInfo->_blockInfo ebn_addRootEntry:entryInfo];
 			
 	// If the table had been empty, but now isn't, this means the given property
 	// is now being observed (and wasn't before now). Inform ourselves.
@@ -1085,34 +1026,15 @@ NSObject						*EBN_InvalidPropertyKey;
 
 	// Remove the entry from the observer table for the given property.
 	// If the entry is in the table multiple times, be sure to only remove one instance.
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	@synchronized(observedKeysDict)
-	{
-		// Important that here we use propName and not look inside entryInfo to pull the property
-		// from the keypath.
-		NSMutableArray *observers = observedKeysDict[propName];
-		for (int index = 0; index < observers.count; ++index)
-		{
-			EBNKeypathEntryInfo *indexedEntry = observers[index];
-			if (indexedEntry->_blockInfo == entryInfo->_blockInfo &&
-					indexedEntry->_keyPathIndex == pathIndex &&
-					[indexedEntry->_keyPath isEqualToArray:entryInfo->_keyPath])
-			{
-				removedEntry = indexedEntry;
-				[observers removeObjectAtIndex:index];
-				break;
-			}
-		}
-				
-		if (observers && ![observers count])
-		{
-			[observedKeysDict removeObjectForKey:propName];
-			observerTableRemoved = true;
-		}
-	}
-		
-	// If nobody is observing this property anymore, inform ourselves
-	if (observerTableRemoved && [self respondsToSelector:@selector(property:observationStateIs:)])
+	// Important that here we use propName and not look inside entryInfo to pull the property
+	// from the keypath.
+	removedEntry = [[self ebn_observationTable:NO] removeEntry:entryInfo atIndex:pathIndex forKey:propName
+			keyRemoved:&observerTableRemoved];
+	if (removedEntry && pathIndex == 0)
+		[removedEntry->_blockInfo ebn_removeRootEntry:removedEntry];
+		
+	// If nobody is observing this property anymore, inform ourselves
+	if (observerTableRemoved && [self respondsToSelector:@selector(property:observationStateIs:)])
 	{
 		NSObject <EBNObserverNotificationProtocol> *target = (NSObject<EBNObserverNotificationProtocol> *) self;
 		[target property:propName observationStateIs:FALSE];
@@ -1132,35 +1054,48 @@ NSObject						*EBN_InvalidPropertyKey;
 	any point in the keypath. Some of the blocks we check could be rooted in self; others not.
 	
 	Rember that the lifetime of an observer block should be until either the observed or observing
-	object goes away (or it's explicitly removed). However, since there isn't a notifying zeroing 
-	weak pointer, we do this to clean up.
+	object goes away (or it's explicitly removed). Observers get a sentinel that removes their observations 
+	when they dealloc, so this mostly finds nothing; it's here to catch observations the sentinel couldn't
+	remove, such as ones whose observer went away while their observed object was being deallocated.
 	
 	Returns the number of blocks that got reaped.
 */
 - (int) ebn_reapBlocks
 {
 	int removedBlockCount = 0;
-	NSMutableSet *entriesToRemove = [[NSMutableSet alloc] init];
+	NSMutableSet *observationsToRemove = nil;
+	NSMutableArray *entriesToRemove = nil;
 
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+	// Find the observations whose observer is gone. Each one then removes all its keypaths via its own
+	// root entries. LazyLoader observations aren't in the reverse index, so remove their entries one by one.
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	for (NSString *propertyKey in [observationTable allKeys])
 	{
-		@synchronized(observedKeysDict)
+		for (EBNKeypathEntryInfo *entry in [observationTable entriesForKey:propertyKey])
 		{
-			for (NSString *propertyKey in [observedKeysDict allKeys])
+			EBNObservation *blockInfo = entry->_blockInfo;
+			if (blockInfo->_weakObserver)
+				continue;
+				
+			if (blockInfo.isForLazyLoader)
 			{
-				NSMutableArray *observers = observedKeysDict[propertyKey];
-				for (EBNKeypathEntryInfo *entry in observers)
-				{
-					if (!entry->_blockInfo->_weakObserver)
-					{
-						[entriesToRemove addObject:entry];
-					}
-				}
+				if (!entriesToRemove)
+					entriesToRemove = [[NSMutableArray alloc] init];
+				[entriesToRemove addObject:entry];
+			}
+			else
+			{
+				if (!observationsToRemove)
+					observationsToRemove = [[NSMutableSet alloc] init];
+				[observationsToRemove addObject:blockInfo];
 			}
 		}
 	}
-		
+	
+	for (EBNObservation *observation in observationsToRemove)
+	{
+		removedBlockCount += (int) [observation ebn_stopObservingKeypath:nil];
+	}
 	for (EBNKeypathEntryInfo *entry in entriesToRemove)
 	{
 		if ([entry ebn_removeObservation])
@@ -1651,11 +1586,11 @@ NSObject						*EBN_InvalidPropertyKey;
 		[debugStr appendFormat:@"    This object is not set up to observe anything (not isa-swizzled)\n"];
 	}
 
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	for (NSString *observedMethod in observedKeysDict)
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	for (NSString *observedMethod in [observationTable allKeys])
 	{
 		[debugStr appendFormat:@"    %@ notifies:\n", observedMethod];
-		NSMutableArray *keypathEntries = observedKeysDict[observedMethod];
+		NSArray *keypathEntries = [observationTable entriesForKey:observedMethod];
 		for (EBNKeypathEntryInfo *entry in keypathEntries)
 		{
 			EBNObservation *blockInfo = entry->_blockInfo;
@@ -1672,13 +1607,7 @@ NSObject						*EBN_InvalidPropertyKey;
 			
 			if (entry->_keyPath.count > 1)
 			{
-				[debugStr appendFormat:@" path:"];
-				NSString *separator = @"";
-				for (NSString *prop in entry->_keyPath)
-				{
-					[debugStr appendFormat:@"%@%@", separator, prop];
-					separator = @".";
-				}
+				[debugStr appendFormat:@" path:%@", entry->_keyPath->_string];
 			}
 			
 			// Show a warning if this observation has non-swizzled objects in its keypath
@@ -1711,6 +1640,271 @@ NSObject						*EBN_InvalidPropertyKey;
 
 @end
 
+#pragma mark - Accessor Cache
+
+/**
+	Resolving a property's accessors takes several runtime lookups and some parsing of the property's attribute 
+	string. Keypath compares and ebn_valueForKey: need the accessors every time they run, so we cache them
+	per (class, property).
+	
+	Each class in the cache has a generation, and each cache entry records its class's generation when it was
+	resolved. Replacing an accessor method in a shadow class bumps the generation of that class and of its
+	cached subclasses, and their entries from older generations get resolved again on their next lookup.
+	Entries for other classes stay valid.
+*/
+struct EBNAccessorCacheKey
+{
+	Class		_class;
+	NSString	*_propertyName;
+
+	bool operator==(const EBNAccessorCacheKey &other) const
+	{
+		return _class == other._class && (_propertyName == other._propertyName ||
+				[_propertyName isEqualToString:other._propertyName]);
+	}
+};
+
+struct EBNAccessorCacheKeyHash
+{
+	size_t operator()(const EBNAccessorCacheKey &key) const
+	{
+		return std::hash<void *>()((__bridge void *) key._class) ^ [key._propertyName hash];
+	}
+};
+
+struct EBNAccessorCacheEntry
+{
+	EBNPropertyAccessors	_accessors;
+	NSUInteger				_generation;		// The generation of the entry's class when it was resolved
+};
+
+	// The cache, and the current generation of each class that has entries in it. Both guarded by EBNAccessorCacheLock.
+	// Invalidations also bump the invalidation count, so lookups that were resolving during one don't store stale results.
+static pthread_rwlock_t			EBNAccessorCacheLock = PTHREAD_RWLOCK_INITIALIZER;
+static std::unordered_map<EBNAccessorCacheKey, EBNAccessorCacheEntry, EBNAccessorCacheKeyHash> *EBNAccessorCache;
+static std::unordered_map<void *, NSUInteger> *EBNAccessorClassGenerations;
+static std::atomic<NSUInteger>	EBNAccessorCacheInvalidations;
+
+static SEL EBNResolvePropertyGetter(Class baseClass, NSString * propertyName);
+static SEL EBNResolvePropertySetter(Class baseClass, NSString * propertyName);
+
+	// Property type strings, interned so that cache entries can point at them
+static pthread_mutex_t			EBNPropertyTypePoolLock = PTHREAD_MUTEX_INITIALIZER;
+static std::unordered_set<std::string> *EBNPropertyTypePool;
+
+	// The property name sets returned by EBNAllPropertiesForClass(). Entries are never removed.
+static pthread_rwlock_t			EBNClassPropertiesLock = PTHREAD_RWLOCK_INITIALIZER;
+static std::unordered_map<void *, NSSet<NSString *> *> *EBNClassProperties;
+
+/****************************************************************************************************
+	EBNInternPropertyType()
+	
+	Returns a string equal to type that's valid forever. Properties only use a handful of different
+	types, so the pool stays small.
+*/
+static const char *EBNInternPropertyType(const char *type)
+{
+	pthread_mutex_lock(&EBNPropertyTypePoolLock);
+	if (!EBNPropertyTypePool)
+		EBNPropertyTypePool = new std::unordered_set<std::string>();
+	const char *result = EBNPropertyTypePool->insert(type).first->c_str();
+	pthread_mutex_unlock(&EBNPropertyTypePoolLock);
+	
+	return result;
+}
+
+/****************************************************************************************************
+	EBNResolvePropertyAccessors()
+	
+	Does the uncached work of EBNAccessorsForProperty().
+*/
+static EBNPropertyAccessors EBNResolvePropertyAccessors(Class baseClass, NSString *propertyName)
+{
+	EBNPropertyAccessors accessors = { };
+
+	SEL getterSelector = EBNResolvePropertyGetter(baseClass, propertyName);
+	Method getterMethod = getterSelector ? class_getInstanceMethod(baseClass, getterSelector) : NULL;
+	if (getterMethod)
+	{
+		accessors._getterSEL = getterSelector;
+		accessors._getterIMP = method_getImplementation(getterMethod);
+		accessors._getterTypeEncoding = method_getTypeEncoding(getterMethod);
+		accessors._getterThunk = EBNGetterThunkForMethod(getterMethod);
+	}
+	
+	objc_property_t property = class_getProperty(baseClass, [propertyName UTF8String]);
+	char *propertyType = property ? property_copyAttributeValue(property, "T") : NULL;
+	if (propertyType)
+	{
+		accessors._propertyType = EBNInternPropertyType(propertyType);
+		free(propertyType);
+	}
+	
+	SEL setterSelector = EBNResolvePropertySetter(baseClass, propertyName);
+	if (setterSelector)
+	{
+		// Setters can be found via respondsToSelector:, which could be true without there being a Method
+		accessors._setterSEL = setterSelector;
+		Method setterMethod = class_getInstanceMethod(baseClass, setterSelector);
+		if (setterMethod)
+		{
+			accessors._setterIMP = method_getImplementation(setterMethod);
+			accessors._setterTypeEncoding = method_getTypeEncoding(setterMethod);
+		}
+	}
+	
+	return accessors;
+}
+
+/****************************************************************************************************
+	EBNAccessorsForProperty()
+	
+*/
+EBNPropertyAccessors EBNAccessorsForProperty(Class baseClass, NSString *propertyName)
+{
+	// Read the invalidation count before resolving, so that if an invalidation happens while we're
+	// resolving, we don't cache what we resolved.
+	NSUInteger invalidations = EBNAccessorCacheInvalidations.load();
+	EBNAccessorCacheKey key = { baseClass, propertyName };
+	
+	pthread_rwlock_rdlock(&EBNAccessorCacheLock);
+	if (EBNAccessorCache)
+	{
+		// Every class with entries has a generation; don't use operator[] under the read lock
+		auto cacheIter = EBNAccessorCache->find(key);
+		if (cacheIter != EBNAccessorCache->end() &&
+				cacheIter->second._generation == EBNAccessorClassGenerations->find((__bridge void *) baseClass)->second)
+		{
+			EBNPropertyAccessors accessors = cacheIter->second._accessors;
+			pthread_rwlock_unlock(&EBNAccessorCacheLock);
+			return accessors;
+		}
+	}
+	pthread_rwlock_unlock(&EBNAccessorCacheLock);
+	
+	EBNPropertyAccessors accessors = EBNResolvePropertyAccessors(baseClass, propertyName);
+	key._propertyName = [propertyName copy];
+	
+	pthread_rwlock_wrlock(&EBNAccessorCacheLock);
+	if (!EBNAccessorCache)
+	{
+		EBNAccessorCache = new std::unordered_map<EBNAccessorCacheKey, EBNAccessorCacheEntry, EBNAccessorCacheKeyHash>();
+		EBNAccessorClassGenerations = new std::unordered_map<void *, NSUInteger>();
+	}
+	if (EBNAccessorCacheInvalidations.load() == invalidations)
+	{
+		NSUInteger classGeneration = (*EBNAccessorClassGenerations)[(__bridge void *) baseClass];
+		(*EBNAccessorCache)[key] = { accessors, classGeneration };
+	}
+	pthread_rwlock_unlock(&EBNAccessorCacheLock);
+	
+	return accessors;
+}
+
+/****************************************************************************************************
+	EBNPropertyHasValueType()
+	
+	Object properties are encoded with their class name (@"NSString"), which @encode(id) doesn't have, 
+	so any object property matches an object value type. Properties without a declared type match anything.
+*/
+BOOL EBNPropertyHasValueType(Class baseClass, NSString *propertyName, const char *valueType)
+{
+	const char *propertyType = EBNAccessorsForProperty(baseClass, propertyName)._propertyType;
+	if (!propertyType || !strcmp(propertyType, valueType))
+		return YES;
+	
+	return (valueType[0] == _C_ID || valueType[0] == _C_CLASS) && !valueType[1] && propertyType[0] == valueType[0];
+}
+
+/****************************************************************************************************
+	EBNInvalidateAccessorCache()
+	
+	Subclasses inherit modifiedClass's methods, so their entries get invalidated too. The walk is over the
+	classes in the cache, which are few compared to their entries.
+*/
+void EBNInvalidateAccessorCache(Class modifiedClass)
+{
+	pthread_rwlock_wrlock(&EBNAccessorCacheLock);
+	EBNAccessorCacheInvalidations.fetch_add(1);
+	if (EBNAccessorClassGenerations)
+	{
+		for (auto &classGeneration : *EBNAccessorClassGenerations)
+		{
+			for (Class curClass = (__bridge Class) classGeneration.first; curClass; curClass = class_getSuperclass(curClass))
+			{
+				if (curClass == modifiedClass)
+				{
+					++classGeneration.second;
+					break;
+				}
+			}
+		}
+	}
+	pthread_rwlock_unlock(&EBNAccessorCacheLock);
+}
+
+/****************************************************************************************************
+	EBNAllPropertiesForClass()
+	
+	Properties can't be removed from a class, and are almost never added after the class is set up, so
+	these sets don't get invalidated.
+*/
+NSSet<NSString *> *EBNAllPropertiesForClass(Class baseClass)
+{
+	NSSet *propertySet = nil;
+	
+	pthread_rwlock_rdlock(&EBNClassPropertiesLock);
+	if (EBNClassProperties)
+	{
+		auto cacheIter = EBNClassProperties->find((__bridge void *) baseClass);
+		if (cacheIter != EBNClassProperties->end())
+			propertySet = cacheIter->second;
+	}
+	pthread_rwlock_unlock(&EBNClassPropertiesLock);
+	if (propertySet)
+		return propertySet;
+	
+	Class curClass = baseClass;
+	NSMutableSet *newPropertySet = [[NSMutableSet alloc] init];
+
+	// copyPropertyList only gives us properties about the current class--not its superclasses.
+	// So, walk up the class tree, from the current class to NSObject.
+	while (curClass && curClass != [NSObject class])
+	{
+		unsigned int propCount;
+		objc_property_t *properties = class_copyPropertyList(curClass, &propCount);
+		if (properties)
+		{
+			for (int propIndex = 0; propIndex < propCount; ++propIndex)
+			{
+				// Get the name of all the properties, add them to the set. We use a set
+				// to deduplicate properties re-declared in subclasses.
+				NSString *propString = @(property_getName(properties[propIndex]));
+				if (propString)
+				{
+					[newPropertySet addObject:propString];
+				}
+			}
+		
+			free(properties);
+		}
+		
+		curClass = [curClass superclass];
+	}
+	
+	// If another thread built the set first, use theirs, so that every caller gets the same set object
+	pthread_rwlock_wrlock(&EBNClassPropertiesLock);
+	if (!EBNClassProperties)
+		EBNClassProperties = new std::unordered_map<void *, NSSet<NSString *> *>();
+	NSSet *&cachedSet = (*EBNClassProperties)[(__bridge void *) baseClass];
+	if (!cachedSet)
+		cachedSet = [newPropertySet copy];
+	propertySet = cachedSet;
+	pthread_rwlock_unlock(&EBNClassPropertiesLock);
+	
+	return propertySet;
+}
+
 /****************************************************************************************************
 	ebn_selectorForPropertyGetter()
 	
@@ -1719,6 +1913,28 @@ NSObject						*EBN_InvalidPropertyKey;
 	class, or nil.
 */
 SEL ebn_selectorForPropertyGetter(Class baseClass, NSString * propertyName)
+{
+	return EBNAccessorsForProperty(baseClass, propertyName)._getterSEL;
+}
+
+/****************************************************************************************************
+	ebn_selectorForPropertySetter()
+	
+	Returns the SEL for a given property's setter method, given the name of the property as a string 
+	(NOT the name of the setter method). The SEL will be a valid instance method for this
+	class, or nil.
+*/
+SEL ebn_selectorForPropertySetter(Class baseClass, NSString * propertyName)
+{
+	return EBNAccessorsForProperty(baseClass, propertyName)._setterSEL;
+}
+
+/****************************************************************************************************
+	EBNResolvePropertyGetter()
+	
+	Finds the getter for ebn_selectorForPropertyGetter(), without caching.
+*/
+static SEL EBNResolvePropertyGetter(Class baseClass, NSString * propertyName)
 {
 	NSString *getterName = nil;
 	SEL methodSel;
@@ -1771,13 +1987,11 @@ SEL ebn_selectorForPropertyGetter(Class baseClass, NSString * propertyName)
 }
 
 /****************************************************************************************************
-	ebn_selectorForPropertySetter:
+	EBNResolvePropertySetter()
 	
-	Returns the SEL for a given property's setter method, given the name of the property as a string 
-	(NOT the name of the setter method). The SEL will be a valid instance method for this
-	class, or nil.
+	Finds the setter for ebn_selectorForPropertySetter(), without caching.
 */
-SEL ebn_selectorForPropertySetter(Class baseClass, NSString * propertyName)
+static SEL EBNResolvePropertySetter(Class baseClass, NSString * propertyName)
 {
 	// If this is an actual declared property, get the property, then its property attributes string,
 	// then pull out the setter method from the string. Only finds custom setters, but must be done first.
@@ -1789,6 +2003,7 @@ SEL ebn_selectorForPropertySetter(Class baseClass, NSString * propertyName)
 		if (propString)
 		{
 			SEL methodSel = sel_registerName(propString);
+			free(propString);
 			if (methodSel && [baseClass instancesRespondToSelector:methodSel])
 			{
 				return methodSel;
@@ -1941,40 +2156,34 @@ static void ebn_shadowed_dealloc(__unsafe_unretained NSObject *self, SEL _cmd)
 {
 	NSMutableSet *objectsToNotify = [NSMutableSet set];
 	
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	for (NSString *propertyKey in [observationTable allKeys])
 	{
-		@synchronized(observedKeysDict)
+		for (EBNKeypathEntryInfo *entryInfo in [observationTable entriesForKey:propertyKey])
 		{
-			for (NSMutableArray *observers in [observedKeysDict allValues])
+			// Remove all 'downstream' keypath parts; they'll become inaccessable after
+			// this object goes away. This case should only really be hit when this object
+			// is weakly held by its 'upstream' object's keypath property.
+			[entryInfo ebn_updateKeypathAtIndex:entryInfo->_keyPathIndex from:self to:nil];
+			
+			if (entryInfo->_keyPathIndex == 0)
 			{
-				for (EBNKeypathEntryInfo *entryInfo in [observers copy])
+				// Only notify using DeallocProtocol for observations where this object is the base
+				// of the keypath. That is, observer notifications where the notification itself
+				// is going away because this object is the root of the keypath.
+				id object = entryInfo->_blockInfo->_weakObserver;
+				if (object && [object respondsToSelector:@selector(observedObjectHasBeenDealloced:endingObservation:)])
 				{
-					// Remove all 'downstream' keypath parts; they'll become inaccessable after
-					// this object goes away. This case should only really be hit when this object
-					// is weakly held by its 'upstream' object's keypath property.
-					[entryInfo ebn_updateKeypathAtIndex:entryInfo->_keyPathIndex from:self to:nil];
-					
-					if (entryInfo->_keyPathIndex == 0)
-					{
-						// Only notify using DeallocProtocol for observations where this object is the base
-						// of the keypath. That is, observer notifications where the notification itself
-						// is going away because this object is the root of the keypath.
-						id object = entryInfo->_blockInfo->_weakObserver;
-						if (object && [object respondsToSelector:@selector(observedObjectHasBeenDealloced:endingObservation:)])
-						{
-							[objectsToNotify addObject:entryInfo];
-						}
-					}
-					
-					// If index != 0, we could trigger observer notifications here in the case where the
-					// object before us in the keypath is holding on to us via a _weak reference.
-					// We could do it for _unsafe_unretained too, but it's not great design where we notify
-					// observers that we've changed but when they look to see what changed they crash.
-					// If anyone sees this code and realizes they could write a notifying _unsafe_unretained
-					// property wrapper $DIETY help us all.
+					[objectsToNotify addObject:entryInfo];
 				}
 			}
+			
+			// If index != 0, we could trigger observer notifications here in the case where the
+			// object before us in the keypath is holding on to us via a _weak reference.
+			// We could do it for _unsafe_unretained too, but it's not great design where we notify
+			// observers that we've changed but when they look to see what changed they crash.
+			// If anyone sees this code and realizes they could write a notifying _unsafe_unretained
+			// property wrapper $DIETY help us all.
 		}
 	}
 	
@@ -1982,14 +2191,7 @@ static void ebn_shadowed_dealloc(__unsafe_unretained NSObject *self, SEL _cmd)
 	for (EBNKeypathEntryInfo *entry in objectsToNotify)
 	{
 		id observer = entry->_blockInfo->_weakObserver;
-		NSMutableString *keyPathStr = [[NSMutableString alloc] init];
-		NSString *separator = @"";
-		for (NSString *prop in entry->_keyPath)
-		{
-			[keyPathStr appendFormat:@"%@%@", separator, prop];
-			separator = @".";
-		}
-		[observer observedObjectHasBeenDealloced:self endingObservation:keyPathStr];
+		[observer observedObjectHasBeenDealloced:self endingObservation:entry->_keyPath->_string];
 	}
 	
 	// At some point around iOS 9, the behavior of object_setIvar was changed so that the method assumed your
@@ -2011,6 +2213,9 @@ static void ebn_shadowed_dealloc(__unsafe_unretained NSObject *self, SEL _cmd)
 #endif
 		}
 	}
+	
+	// Synthetic properties past the end of the inline validity bitfield keep their bits in separate allocations
+	[self ebn_freeValidityOverflow];
 
 	// If we replaced an earlier dealloc selector IN THIS SHADOWED CLASS (can happen if Apple's KVO adds one, or
 	// if a different entity doing runtime isa-swizzling comes in), call through now
@@ -2033,6 +2238,176 @@ static void ebn_shadowed_dealloc(__unsafe_unretained NSObject *self, SEL _cmd)
 }
 
 
+#pragma mark -
+#pragma mark Change Batches
+
+/**
+	A change batch tracks the observed properties changed on one thread between ebn_beginChanges and the
+	matching ebn_commitChanges. Each changed property is recorded once, with its value from before the
+	first change; later changes to the same property in the same batch only cost a hash set lookup.
+	
+	Each thread's batch is kept in thread-specific storage, and is created the first time the thread begins
+	a batch. Objects with changed properties are retained until the batch commits.
+*/
+struct EBNBatchedChange
+{
+	NSObject		*_object;
+	NSString		*_propertyName;
+	id				_previousValue;		// Boxed, for non-object properties
+	bool			_isObjectValued;
+};
+
+struct EBNBatchedChangeKey
+{
+	void			*_object;
+	void			*_propertyName;
+	
+	bool operator==(const EBNBatchedChangeKey &other) const
+	{
+		return _object == other._object && _propertyName == other._propertyName;
+	}
+};
+
+struct EBNBatchedChangeKeyHash
+{
+	size_t operator()(const EBNBatchedChangeKey &key) const
+	{
+		return std::hash<void *>()(key._object) ^ (std::hash<void *>()(key._propertyName) << 1);
+	}
+};
+
+struct EBNChangeBatch
+{
+	NSUInteger				_depth;
+	std::vector<EBNBatchedChange>	_changes;
+	std::unordered_set<EBNBatchedChangeKey, EBNBatchedChangeKeyHash> _changedProperties;
+};
+
+static pthread_key_t		EBNChangeBatchKey;
+
+/****************************************************************************************************
+	EBNDeleteChangeBatch()
+	
+	Thread-specific storage destructor for change batches.
+*/
+static void EBNDeleteChangeBatch(void *batch)
+{
+	delete (EBNChangeBatch *) batch;
+}
+
+/****************************************************************************************************
+	EBNCurrentChangeBatch()
+	
+	Returns the current thread's change batch. If createIfNone is false, returns NULL unless the thread 
+	is inside a batch. 
+*/
+static EBNChangeBatch *EBNCurrentChangeBatch(bool createIfNone)
+{
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken,
+	^{
+		pthread_key_create(&EBNChangeBatchKey, EBNDeleteChangeBatch);
+	});
+
+	EBNChangeBatch *batch = (EBNChangeBatch *) pthread_getspecific(EBNChangeBatchKey);
+	if (!batch && createIfNone)
+	{
+		batch = new EBNChangeBatch();
+		batch->_depth = 0;
+		pthread_setspecific(EBNChangeBatchKey, batch);
+	}
+	
+	if (!createIfNone && batch && !batch->_depth)
+		return NULL;
+	return batch;
+}
+
+/****************************************************************************************************
+	EBNChangeBatchAddProperty()
+	
+	Records that the given property of the given object changed. Only calls getPreviousValue (which should
+	return the boxed previous value) if this is the property's first change in the batch. Returns true
+	if the property was newly added.
+*/
+static bool EBNChangeBatchAddProperty(EBNChangeBatch *batch, NSObject *object, NSString *propName,
+		id (^getPreviousValue)(void), bool isObjectValued)
+{
+	EBNBatchedChangeKey key = { (__bridge void *) object, (__bridge void *) propName };
+	if (!batch->_changedProperties.insert(key).second)
+		return false;
+	
+	batch->_changes.push_back({ object, propName, getPreviousValue(), isObjectValued });
+	return true;
+}
+
+/****************************************************************************************************
+	EBNCommitChangeBatch()
+	
+	Triggers observers for everything changed in the batch. Observers can make more changes (and start
+	more batches) while this runs; the batch is emptied first, so those changes are handled normally.
+*/
+static void EBNCommitChangeBatch(EBNChangeBatch *batch)
+{
+	std::vector<EBNBatchedChange> changes;
+	changes.swap(batch->_changes);
+	batch->_changedProperties.clear();
+	
+	for (const EBNBatchedChange &change : changes)
+	{
+		// Non-object properties that ended up back where they started didn't change. Object properties
+		// still need their keypaths updated if the object changed, even to an equal object.
+		if (!change._isObjectValued)
+		{
+			id newValue = [change._object ebn_valueForKey:change._propertyName];
+			if ([newValue isEqual:change._previousValue])
+				continue;
+		}
+		
+		[change._object ebn_manuallyTriggerObserversForProperty:change._propertyName
+				previousValue:change._previousValue];
+	}
+}
+
+#pragma mark -
+#pragma mark Triggering Observers
+
+/****************************************************************************************************
+	EBNTriggerObservers()
+	
+	Internal function to trigger observers, used by the manual trigger methods. The caller should check
+	that the previous and new values aren't equal (using ==) and not call this function if they are, but
+	should not check isEqual: (because of how keypath updating works).
+	
+	The caller should have already run the LazyLoader blocks in the snapshot; they get skipped here.
+*/
+static void EBNTriggerObservers(NSObject *observedObject, id prevValue, id newValue, const EBNObserverSnapshot &observers)
+{
+	BOOL reapBlocksAfter = NO;
+
+	// Go through all the observations, update any keypaths that need it.
+	// If we update a keypath, we'll need to evaluate the property value to get the new value
+	observers.forEachEntry([&](EBNKeypathEntryInfo *entry)
+	{
+		// Update the keypath to go through the new object; this also tells us if any endpoint of the keypath
+		// changed value
+		if ([entry ebn_updateNextKeypathEntryFrom:prevValue to:newValue])
+		{
+			EBNObservation *blockInfo = entry->_blockInfo;
+			
+			// We already went through all the lazyloader blocks
+			if (blockInfo.isForLazyLoader)
+				return;
+		
+			// Make sure the observed object still exists before calling/scheduling blocks
+			if (![blockInfo executeWithPreviousValue:prevValue])
+				reapBlocksAfter = YES;
+		}
+	});
+	
+	if (reapBlocksAfter)
+		[observedObject ebn_reapBlocks];
+}
+
 #pragma mark -
 #pragma mark Template Methods
 
@@ -2046,39 +2421,29 @@ BOOL EBNComparePropertyAtIndex(NSInteger index, EBNKeypathEntryInfo *info, NSStr
 {
 	BOOL result = NO;
 	
-	char *propertyTypeStr = nil;
+	// Property types come from the accessor cache, so this doesn't parse attribute strings each time
+	const char *propertyTypeStr = NULL;
 	Class prevObjectClass = [prevObject class];
 	
 	if (prevObject)
 	{
-		objc_property_t prevProp = class_getProperty(prevObjectClass, [propName UTF8String]);
-		propertyTypeStr = property_copyAttributeValue(prevProp, "T");
+		propertyTypeStr = EBNAccessorsForProperty(prevObjectClass, propName)._propertyType;
 	}
 	
 	// If prev and current are the same class, or one is the parent of the other, properties they have
 	// in common must be the same type. Otherwise, check the prop type of the prop in curObject
 	if (curObject && !([curObject isKindOfClass:prevObjectClass] || [prevObject isKindOfClass:[curObject class]]))
 	{
-		objc_property_t curProp = class_getProperty(object_getClass(curObject), [propName UTF8String]);
-		char *curPropTypeStr = property_copyAttributeValue(curProp, "T");
+		const char *curPropTypeStr = EBNAccessorsForProperty(object_getClass(curObject), propName)._propertyType;
 		if (!propertyTypeStr)
 		{
 			propertyTypeStr = curPropTypeStr;
 		}
-		else if (curPropTypeStr)
+		else if (curPropTypeStr && strcmp(propertyTypeStr, curPropTypeStr))
 		{
-			if (strcmp(propertyTypeStr, curPropTypeStr))
-			{
-				// If the previous and current object have values for this property, but they are not the same
-				// type, bail and consider the value changed.
-				free(propertyTypeStr);
-				free(curPropTypeStr);
-				return YES;
-			} 
-			else
-			{			
-				free(curPropTypeStr);
-			}
+			// If the previous and current object have values for this property, but they are not the same
+			// type, bail and consider the value changed.
+			return YES;
 		}
 	}
 	
@@ -2189,7 +2554,6 @@ BOOL EBNComparePropertyAtIndex(NSInteger index, EBNKeypathEntryInfo *info, NSStr
 	break;
 	}
 	
-	free(propertyTypeStr);	
 	return result;
 }
 
@@ -2253,28 +2617,23 @@ template<typename T> inline BOOL EBNComparePropertyEquality(NSString *propName,
 		return YES;
 	}
 		
-	Class prevObjClass = object_getClass(prevObject);
-	SEL getterSelector = ebn_selectorForPropertyGetter(prevObjClass, propName);
-	if (getterSelector)
+	typedef T (*getterMethodFnType)(id, SEL);
+	EBNPropertyAccessors prevAccessors = EBNAccessorsForProperty(object_getClass(prevObject), propName);
+	if (prevAccessors._getterIMP)
 	{
-		typedef T (*getterMethodFnType)(id, SEL);
-		getterMethodFnType getterMethod = (getterMethodFnType)
-				class_getMethodImplementation(prevObjClass, getterSelector);
-		prevPropValue = getterMethod(prevObject, getterSelector);
+		getterMethodFnType getterMethod = (getterMethodFnType) prevAccessors._getterIMP;
+		prevPropValue = getterMethod(prevObject, prevAccessors._getterSEL);
 	}
 	else
 	{
 		return YES;
 	}
 	
-	Class curObjClass = object_getClass(curObject);
-	getterSelector = ebn_selectorForPropertyGetter(curObjClass, propName);
-	if (getterSelector)
+	EBNPropertyAccessors curAccessors = EBNAccessorsForProperty(object_getClass(curObject), propName);
+	if (curAccessors._getterIMP)
 	{
-		typedef T (*getterMethodFnType)(id, SEL);
-		getterMethodFnType getterMethod = (getterMethodFnType) 
-				class_getMethodImplementation(curObjClass, getterSelector);
-		curPropValue = getterMethod(prevObject, getterSelector);
+		getterMethodFnType getterMethod = (getterMethodFnType) curAccessors._getterIMP;
+		curPropValue = getterMethod(curObject, curAccessors._getterSEL);
 	}
 	else
 	{
@@ -2310,6 +2669,42 @@ template<> inline bool EBNUpdateKeypath<id>(const EBNKeypathEntryInfo * const en
 	return [entry ebn_updateNextKeypathEntryFrom:previousValue to:newValue];
 }
 
+/****************************************************************************************************
+	EBNExecuteTypedImmedBlock()
+	
+	Called by overridden setters of properties of type T, for typed immediate observations. If the observation's
+	block takes T, it gets the raw values; otherwise the values get boxed and the boxed block gets them.
+	
+	Returns NO if the observing or observed object has gone away, in which case the caller should reap.
+*/
+template<typename T> static inline BOOL EBNExecuteTypedImmedBlock(EBNObservation *blockInfo, const T previousValue, const T newValue)
+{
+	const char *valueType = @encode(T);
+	if (blockInfo->_typedImmedValueType != valueType && strcmp(blockInfo->_typedImmedValueType, valueType))
+	{
+		return [blockInfo executeBoxedImmedBlockWithPreviousValue:EBNWrapValue(previousValue)
+				newValue:EBNWrapValue(newValue)];
+	}
+	
+	NSObject *blockObserved = blockInfo->_weakObserved;
+	id blockObserver = blockInfo->_weakObserver;
+	if (!blockObserved || !blockObserver)
+		return NO;
+
+	if (blockInfo.willDebugBreakOnInvoke && EBNIsADebuggerConnected())
+	{
+		EBLogStdOut(@"debugBreakOnInvoke breakpoint hit! %@", blockInfo.debugString.length ? blockInfo.debugString : @"");
+
+		// This line will cause a break in the debugger! If you stop here in the debugger, it is
+		// because someone set debugBreakOnInvoke on this observation and it's about to invoked.
+		DEBUG_BREAKPOINT;
+	}
+	
+	EBNTypedImmedBlock<T> typedBlock = blockInfo->_copiedTypedImmedBlock;
+	typedBlock(blockObserver, blockObserved, previousValue, newValue);
+	return YES;
+}
+
 /****************************************************************************************************
 	template <T> overrideSetterMethod()
 	
@@ -2324,30 +2719,43 @@ template<typename T> void overrideSetterMethod(NSString *propName,
 	SEL setterSEL = method_getName(setter);
 	SEL getterSEL = method_getName(getter);
 	
+	// Look up the property's slot in observation tables now, so the setter doesn't have to hash propName.
+	EBNPropertySlotMap * __unsafe_unretained slotMap = classInfo->_propertySlots;
+	NSInteger propSlot = [slotMap slotForKey:propName create:YES];
+	Ivar observationTableIvar = classInfo->_observationTableIvar;
+	EBNSlotObservedCounts observedCounts = EBNSlotMapObservedCounts(slotMap, propSlot);
+	
+	// Same for the property's validity bit, for classes that have one. Bit indexes never change once assigned.
+	// A property that isn't synthetic yet can still become synthetic up until the class is registered,
+	// so those setters look the index up in the frozen table instead.
+	EBNShadowedClassInfo * __unsafe_unretained setterClassInfo = classInfo;
+	NSInteger validityIndex = NSNotFound;
+	BOOL markValid = NO;
+	@synchronized (EBNBaseClassToShadowInfoTable)
+	{
+		validityIndex = [classInfo->_getters indexOfObject:propName];
+		markValid = validityIndex != NSNotFound || !classInfo->_allocHasHappened;
+	}
+	
 	// This is what gets run when the setter method gets called.
 	void (^setAndObserve)(NSObject *, T) = ^void (NSObject *blockSelf, T newValue)
 	{
-		// Do we have any observers active on this property?
-		NSMutableArray *observers = NULL;
-		NSMutableDictionary *observedKeysDict = [blockSelf ebn_observedKeysDict:NO];
-		if (observedKeysDict)
-		{
-			@synchronized(observedKeysDict)
-			{
-				observers = [observedKeysDict[propName] mutableCopy];
-				NSMutableArray *splatObservers = observedKeysDict[@"*"];
-				if (observers && splatObservers)
-					[observers addObjectsFromArray:splatObservers];
-				else if (splatObservers && !observers)
-					observers = [splatObservers copy];				
-			}
-		}
+		// Do we have any observers active on this property? The snapshot doesn't copy or lock anything;
+		// the observer lists it points to can't change while we hold it. Tables in associated objects are
+		// slow to look up, so skip that when no instance of this class is observing the property.
+		EBNObservationTable *observationTable = nil;
+		if (observationTableIvar)
+			observationTable = object_getIvar(blockSelf, observationTableIvar);
+		else if (observedCounts.mayHaveObservers())
+			observationTable = objc_getAssociatedObject(blockSelf, @selector(ebn_observationTable:));
+		EBNObserverSnapshot observers(observationTable, slotMap, propSlot, propName);
 				
 		// If there's no observers, call the original setter, mark the property valid, and return
-		if (!observers)
+		if (observers.isEmpty())
 		{
 			(originalSetter)(blockSelf, setterSEL, newValue);
-			[blockSelf ebn_markPropertyValid:propName];
+			if (markValid)
+				EBNMarkPropertyValid(blockSelf, setterClassInfo, validityIndex, propName);
 			return;
 		}
 		
@@ -2359,16 +2767,27 @@ template<typename T> void overrideSetterMethod(NSString *propName,
 		
 		// If we call the getter, we don't need to do this. If we instead get the previous value via ivar,
 		// we'll need to.
-		[blockSelf ebn_markPropertyValid:propName];
+		if (markValid)
+			EBNMarkPropertyValid(blockSelf, setterClassInfo, validityIndex, propName);
+		
+		// Inside a change batch, just record the change; committing the batch does everything below.
+		if (EBNChangeBatch *batch = EBNCurrentChangeBatch(false))
+		{
+			if (!EBN_PropertyEqualityTest(previousValue, newValue))
+			{
+				EBNChangeBatchAddProperty(batch, blockSelf, propName, ^{ return EBNWrapValue(previousValue); },
+						std::is_same<T, id>::value);
+			}
+			return;
+		}
 		
 		// If the value actually changes do all the observation stuff
 		if (!EBN_PropertyEqualityTest(previousValue, newValue))
 		{
-			BOOL prevValueHasBeenWrapped = NO;
-			id wrappedPreviousValue = nil;
+			BOOL reapAfterIterating = NO;
 			NSMutableArray *delayedObservers = NULL;
 			
-			for (EBNKeypathEntryInfo *entry in observers)
+			observers.forEachEntry([&](EBNKeypathEntryInfo *entry)
 			{
 				// Update the keypath, and check for path semantic equality
 				// Only the object specialization actually implements this
@@ -2395,17 +2814,18 @@ template<typename T> void overrideSetterMethod(NSString *propName,
 					}
 				}
 				
-				// If this is an immed block, wrap the previous value and call it.
-				// Why not just call [blockSelf valueForKey:]? Immed blocks shouldn't be used much
-				// and we'd have to call valueForKey before setting the new value.
+				// If this is an immed block, call it. Plain immed blocks don't get the previous value, so
+				// there's no need to box it.
 				if (blockInfo->_copiedImmedBlock)
 				{
-					if (!prevValueHasBeenWrapped)
-					{
-						wrappedPreviousValue = EBNWrapValue(previousValue);
-						prevValueHasBeenWrapped = YES;
-					}
-					[blockInfo executeImmedBlockWithPreviousValue:wrappedPreviousValue];
+					[blockInfo executeImmedBlockWithPreviousValue:nil];
+				}
+				
+				// Typed immed blocks get the raw values, if this is the end of their keypath
+				if (blockInfo->_copiedTypedImmedBlock && entry->_keyPathIndex == entry->_keyPath.count - 1)
+				{
+					if (!EBNExecuteTypedImmedBlock(blockInfo, previousValue, newValue))
+						reapAfterIterating = YES;
 				}
 				
 				if (pathValueChanged && blockInfo->_copiedBlock)
@@ -2414,21 +2834,102 @@ template<typename T> void overrideSetterMethod(NSString *propName,
 						delayedObservers = [[NSMutableArray alloc] init];
 					[delayedObservers addObject:entry];
 				}
-			}
+			});
 			
 			// Add these blocks to the global collections of "run later" blocks. Reap blocks
 			// if any of blocks have become zombies (observed object has been dealloc'ed).
-			if (delayedObservers.count)
-			{
-				if ([EBNObservation scheduleBlocks:delayedObservers])
-					[blockSelf ebn_reapBlocks];
-			}
+			if (delayedObservers.count && [EBNObservation scheduleBlocks:delayedObservers])
+				reapAfterIterating = YES;
+			if (reapAfterIterating)
+				[blockSelf ebn_reapBlocks];
 		}
 	};
 
 	// Now replace the setter's implementation with the new one
 	IMP swizzledImplementation = imp_implementationWithBlock(setAndObserve);
 	class_replaceMethod(classInfo->_shadowClass, setterSEL, swizzledImplementation, method_getTypeEncoding(setter));
+	EBNInvalidateAccessorCache(classInfo->_shadowClass);
+}
+
+/****************************************************************************************************
+	EBNLaneForPriority()
+	
+	Drains run blocks lane by lane, lowest lane first.
+*/
+static inline NSUInteger EBNLaneForPriority(EBNObservationPriority priority)
+{
+	switch (priority)
+	{
+	case EBNObservationPriorityVisibleUI:	return 0;
+	case EBNObservationPriorityBackground:	return 2;
+	default:								return 1;
+	}
+}
+
+/****************************************************************************************************
+	EBNRunConcurrentBlocks()
+	
+	Runs the given concurrent-safe observations, spread across up to EBNDrainConcurrency threads, and 
+	returns when they're all done. Adds the observed objects of observations that couldn't run to objectsToReap.
+*/
+static void EBNRunConcurrentBlocks(const std::vector<EBNObservation *> &blocks, NSMutableSet * __strong *objectsToReap)
+{
+	size_t count = blocks.size();
+	size_t threadCount = EBNDrainConcurrency ? EBNDrainConcurrency : [[NSProcessInfo processInfo] activeProcessorCount];
+	threadCount = MIN(threadCount, count);
+	
+	// Each thread takes every threadCount'th block, and notes which blocks couldn't run
+	std::vector<char> blockFailed(count, 0);
+	const std::vector<EBNObservation *> *blockList = &blocks;
+	char *failedList = blockFailed.data();
+	void (^runBlocks)(size_t) = ^(size_t threadIndex)
+	{
+		EBNSetDrainWorkerThread(true);
+		@autoreleasepool
+		{
+			for (size_t index = threadIndex; index < count; index += threadCount)
+			{
+				if (![(*blockList)[index] execute])
+					failedList[index] = 1;
+			}
+		}
+		EBNSetDrainWorkerThread(false);
+	};
+	
+	if (threadCount > 1)
+		dispatch_apply(threadCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), runBlocks);
+	else
+		runBlocks(0);
+	
+	for (size_t index = 0; index < count; ++index)
+	{
+		if (failedList[index])
+		{
+			if (!*objectsToReap)
+				*objectsToReap = [NSMutableSet set];
+			[*objectsToReap addObject:blocks[index]->_weakObserved];
+		}
+	}
+}
+
+/****************************************************************************************************
+	EBNCarryOverObservation()
+	
+	Adds the given observation to the next drain's backlog, keeping its observed object alive until then.
+	Returns false if the observation was already carried over by this drain, or its observed object is gone.
+*/
+static bool EBNCarryOverObservation(EBNObservation *blockInfo, NSUInteger lane, NSUInteger drainStamp)
+{
+	NSObject *observed = blockInfo->_weakObserved;
+	if (blockInfo->_lastDrainCarriedOver == drainStamp || !observed)
+		return false;
+	
+	blockInfo->_lastDrainCarriedOver = drainStamp;
+	EBNDrainBacklog[lane].push_back(blockInfo);
+	if (!EBNDrainBacklogKeepAlive)
+		EBNDrainBacklogKeepAlive = [[NSMutableArray alloc] init];
+	[EBNDrainBacklogKeepAlive addObject:observed];
+	return true;
 }
 
 /****************************************************************************************************
@@ -2437,69 +2938,246 @@ template<typename T> void overrideSetterMethod(NSString *propName,
 	This method is a CFRunLoopObserver, scheduled with kCFRunLoopBeforeWaiting, so it fires just before
 	the run loop idles.
 	
-	Calls all the observer blocks that got scheduled during the current runloop.
+	Calls all the observer blocks that got scheduled during the current runloop, plus any that the previous
+	drain carried over. If there's a time budget, blocks that don't fit are carried over to the next drain.
+	Blocks that other threads schedule again after they've run are also carried over, so no change from 
+	another thread goes unreported.
 */
 void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info)
 {
-	// Make a copy the list of blocks we need to call. This copy goes into a global that is only
-	// mutated by the main thread. So, after this sync, all other threads that mutate observed
-	// properties are adding blocks to EBN_ObserverBlocksToRunAfterThisEvent, which will schedule
-	// the block for the next time this method is called. Blocks scheduled by the main thread (which
-	// functionally means blocks scheduled due to code in other blocks) will be added to the BeingDrained set.
-	@synchronized(EBNObservableSynchronizationToken)
-	{
-		if (![EBN_ObserverBlocksToRunAfterThisEvent count])
-			return;
-
-		EBN_ObserverBlocksBeingDrained = [EBN_ObserverBlocksToRunAfterThisEvent mutableCopy];
-		[EBN_ObserverBlocksToRunAfterThisEvent removeAllObjects];
-		EBN_ObservedObjectBeingDrainedKeepAlive = EBN_ObservedObjectKeepAlive;
-		EBN_ObservedObjectKeepAlive = [[NSMutableArray alloc] init];
-	}
-	
-	// Observers could set properties, creating more observation blocks. We should call those
-	// observers too, unless it will cause recursion. The idea is the masterCallList tracks
-	// every block we've called during this event, and we only call any particular block once.
-	NSMutableSet *masterCallList = [NSMutableSet set];
+	// Start with whatever the last drain carried over; those are older than anything in the schedule queue
+	std::vector<EBNTakenObservation> callList;
+	for (NSUInteger lane = 0; lane < kEBNPriorityLaneCount; ++lane)
+	{
+		for (EBNObservation *blockInfo : EBNDrainBacklog[lane])
+			callList.push_back({ blockInfo, false });
+		EBNDrainBacklog[lane].clear();
+	}
+	bool hasBacklog = !callList.empty();
+	NSMutableArray *keepAlive = EBNDrainBacklogKeepAlive;
+	EBNDrainBacklogKeepAlive = nil;
+	
+	// Take everything in the schedule queue into a list that only the main thread touches. After this, 
+	// all threads that mutate observed properties (including the main thread, running the blocks below) 
+	// are adding blocks to the schedule queue.
+	if (!EBNTakeScheduledObservations(callList, &keepAlive) && !hasBacklog)
+		return;
 	
+	CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+	NSUInteger drainStamp = ++EBNDrainCounter;
+	NSUInteger blocksRun = 0;
+	NSUInteger budgetedBlocksRun = 0;
+	NSUInteger cascadeDepth = 0;
+	NSUInteger blocksCarriedOver = 0;
+	bool overBudget = false;
+
 	// If we find any blocks whose observer objects have been dealloc'ed, we will want to call reapBlocks on
 	// those observed objects, but we only need to call reap once per object.
 	NSMutableSet *objectsToReap = nil;
 	
-	while (EBN_ObserverBlocksBeingDrained)
-	{
-		// Step 1: Copy the list of objects that have blocks that need to be called
-		NSMutableSet *thisIterationCallList = [EBN_ObserverBlocksBeingDrained mutableCopy];
+	// Observers could set properties, creating more observation blocks. We should call those
+	// observers too, unless it will cause recursion. Each observation gets stamped with the drain
+	// that ran it, and we only call any particular block once per drain. Blocks that get scheduled again
+	// after they ran are dropped if the drain's own blocks did it, as otherwise blocks that set their own
+	// properties would run on every runloop pass forever; if other threads did it, they're carried over
+	// to the next drain.
+	// Each pass sorts the blocks taken since the last pass into lanes, and then runs lanes in priority order.
+	// Other threads can keep scheduling blocks while we drain, so the number of passes is capped; whatever
+	// is still in the schedule queue after the last pass gets picked up by the next drain.
+	std::vector<EBNObservation *> lanes[kEBNPriorityLaneCount];
+	size_t laneIndex[kEBNPriorityLaneCount] = { };
+	std::vector<EBNObservation *> concurrentBlocks;
+	do
+	{
+		for (EBNTakenObservation &taken : callList)
+		{
+			EBNObservation *blockInfo = taken._observation;
+			if (blockInfo->_lastDrainRun == drainStamp)
+			{
+				if (!taken._scheduledByDrain && EBNCarryOverObservation(blockInfo, EBNLaneForPriority(blockInfo.priority), drainStamp))
+					++blocksCarriedOver;
+			}
+			else if (blockInfo.isConcurrentSafe)
+			{
+				concurrentBlocks.push_back(blockInfo);
+			}
+			else
+			{
+				lanes[EBNLaneForPriority(blockInfo.priority)].push_back(blockInfo);
+			}
+		}
+		callList.clear();
 		
-		// Step 2: Add the blocks we're going go call to the master list
-		[masterCallList unionSet:thisIterationCallList];
-
-		// Step 3: Call each observation block
-		for (EBNObservation *blockInfo in thisIterationCallList)
+		EBN_ObservedObjectBeingDrainedKeepAlive = keepAlive;
+		++cascadeDepth;
+		
+		// Concurrent-safe blocks go first, all at once; this waits until they're all done. A block can
+		// be in the list twice if it was carried over and then scheduled again, so stamp out duplicates first.
+		if (!concurrentBlocks.empty())
 		{
-			if (![blockInfo execute])
+			size_t uniqueCount = 0;
+			for (EBNObservation *blockInfo : concurrentBlocks)
 			{
-				// We are holding the observed object in the keepAlive array; _weakObserved should be non-nil
-				if (!objectsToReap)
-					objectsToReap = [NSMutableSet set];
-				[objectsToReap addObject:blockInfo->_weakObserved];
+				if (blockInfo->_lastDrainRun == drainStamp)
+					continue;
+				blockInfo->_lastDrainRun = drainStamp;
+				concurrentBlocks[uniqueCount++] = blockInfo;
 			}
+			concurrentBlocks.resize(uniqueCount);
+			blocksRun += concurrentBlocks.size();
+			EBNRunConcurrentBlocks(concurrentBlocks, &objectsToReap);
+			concurrentBlocks.clear();
 		}
-
-		// Step 4: Remove any blocks we've already called from the global set
-		[EBN_ObserverBlocksBeingDrained minusSet:masterCallList];
-		if (![EBN_ObserverBlocksBeingDrained count])
-			EBN_ObserverBlocksBeingDrained = nil;
-	}
+		
+		for (NSUInteger lane = 0; lane < kEBNPriorityLaneCount; ++lane)
+		{
+			std::vector<EBNObservation *> &laneBlocks = lanes[lane];
+			for (; laneIndex[lane] < laneBlocks.size(); ++laneIndex[lane])
+			{
+				EBNObservation *blockInfo = laneBlocks[laneIndex[lane]];
+				
+				// Duplicates that were sorted into this lane before the block ran
+				if (blockInfo->_lastDrainRun == drainStamp)
+					continue;
+				
+				// VisibleUI blocks always run. Everything else stops once we're over budget.
+				if (lane != 0 && EBNDrainTimeBudget > 0)
+				{
+					if (!overBudget && budgetedBlocksRun && CFAbsoluteTimeGetCurrent() - startTime >= EBNDrainTimeBudget)
+						overBudget = true;
+					if (overBudget)
+						break;
+					++budgetedBlocksRun;
+				}
+				blockInfo->_lastDrainRun = drainStamp;
+				
+				++blocksRun;
+				if (![blockInfo execute])
+				{
+					// We are holding the observed object in the keepAlive array; _weakObserved should be non-nil
+					if (!objectsToReap)
+						objectsToReap = [NSMutableSet set];
+					[objectsToReap addObject:blockInfo->_weakObserved];
+				}
+			}
+		}
+	} while (cascadeDepth < kEBNMaxCascadeDepth && EBNTakeScheduledObservations(callList, &keepAlive));
 	
-	// Step 5. Reap
+	// Reap
 	for (NSObject *obj in objectsToReap)
 	{
 		[obj ebn_reapBlocks];
 	}
 	
-	// We're done notifying observers, purge the retains we've been keeping
+	// Carry over the blocks we didn't get to, along with their observed objects. Duplicates of blocks that
+	// ran in this drain aren't carried over; neither are blocks whose observed object has gone away.
+	if (overBudget)
+	{
+		for (NSUInteger lane = 0; lane < kEBNPriorityLaneCount; ++lane)
+		{
+			for (size_t index = laneIndex[lane]; index < lanes[lane].size(); ++index)
+			{
+				EBNObservation *blockInfo = lanes[lane][index];
+				if (blockInfo->_lastDrainRun != drainStamp && EBNCarryOverObservation(blockInfo, lane, drainStamp))
+					++blocksCarriedOver;
+			}
+		}
+	}
+	
+	// Make sure there's another runloop pass to run the backlog, or whatever we left in the schedule queue,
+	// even if nothing else happens
+	if (blocksCarriedOver || cascadeDepth >= kEBNMaxCascadeDepth)
+		CFRunLoopWakeUp(CFRunLoopGetMain());
+	
+	// Release the observations before the observed objects
+	callList.clear();
+	for (NSUInteger lane = 0; lane < kEBNPriorityLaneCount; ++lane)
+		lanes[lane].clear();
 	EBN_ObservedObjectBeingDrainedKeepAlive = nil;
+	keepAlive = nil;
+	
+	CFTimeInterval drainTime = CFAbsoluteTimeGetCurrent() - startTime;
+	EBNCurrentDrainStatistics.drainCount++;
+	EBNCurrentDrainStatistics.totalBlocksRun += blocksRun;
+	EBNCurrentDrainStatistics.totalDrainTime += drainTime;
+	EBNCurrentDrainStatistics.maxCascadeDepth = MAX(EBNCurrentDrainStatistics.maxCascadeDepth, cascadeDepth);
+	EBNCurrentDrainStatistics.lastBlocksRun = blocksRun;
+	EBNCurrentDrainStatistics.lastCascadeDepth = cascadeDepth;
+	EBNCurrentDrainStatistics.lastDrainTime = drainTime;
+	EBNCurrentDrainStatistics.lastBlocksCarriedOver = blocksCarriedOver;
+}
+
+/****************************************************************************************************
+	EBNSetDrainTimeBudget()
+	
+*/
+void EBNSetDrainTimeBudget(CFTimeInterval budget)
+{
+	EBNDrainTimeBudget = MAX(budget, 0);
+}
+
+/****************************************************************************************************
+	EBNGetDrainTimeBudget()
+	
+*/
+CFTimeInterval EBNGetDrainTimeBudget(void)
+{
+	return EBNDrainTimeBudget;
+}
+
+/****************************************************************************************************
+	EBNSetDrainConcurrency()
+	
+*/
+void EBNSetDrainConcurrency(NSUInteger maxThreads)
+{
+	EBNDrainConcurrency = maxThreads;
+}
+
+/****************************************************************************************************
+	EBNGetDrainBacklogCount()
+	
+*/
+NSUInteger EBNGetDrainBacklogCount(EBNObservationPriority priority)
+{
+	return EBNDrainBacklog[EBNLaneForPriority(priority)].size();
+}
+
+/****************************************************************************************************
+	EBNPrepareClassesForObservation()
+	
+*/
+void EBNPrepareClassesForObservation(NSArray<Class> *classes, dispatch_block_t completion)
+{
+	NSArray *classesToPrepare = [classes copy];
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0),
+	^{
+		for (Class classToPrepare in classesToPrepare)
+		{
+			[classToPrepare ebn_prepareForObservationOfProperties:nil];
+		}
+		
+		if (completion)
+			dispatch_async(dispatch_get_main_queue(), completion);
+	});
+}
+
+/****************************************************************************************************
+	EBNGetDrainStatistics()
+	
+*/
+EBNDrainStatistics EBNGetDrainStatistics(void)
+{
+	return EBNCurrentDrainStatistics;
+}
+
+/****************************************************************************************************
+	EBNResetDrainStatistics()
+	
+*/
+void EBNResetDrainStatistics(void)
+{
+	EBNCurrentDrainStatistics = EBNDrainStatistics();
 }
 
 /****************************************************************************************************
@@ -25,19 +25,39 @@ extern NSMapTable				*EBNBaseClassToShadowInfoTable;
 
 /**
 	Used as a private, global @synchronize token for EBNObservable. Your code should not sync against this.
-	Currently points to EBN_ObserverBlocksToRunAfterThisEvent, but *could* point to any global object.
 */
-extern NSMutableSet				*EBNObservableSynchronizationToken;
+extern NSObject					*EBNObservableSynchronizationToken;
 
 /**
-	These keep track of the blocks that we need to execute at the end of the current runloop. The *beingDrained
-	variants are for blocks added to the list while we're in the process of executing the blocks.
+	Keeps the observed objects of the blocks being executed at the end of the current runloop alive while
+	that happens. Only the main thread uses this.
 */
-extern NSMutableSet				*EBN_ObserverBlocksToRunAfterThisEvent;
-extern NSMutableSet				*EBN_ObserverBlocksBeingDrained;
-extern NSMutableArray			*EBN_ObservedObjectKeepAlive;
 extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
 
+/**
+	The schedule queue, for blocks we need to execute at the end of the current runloop. Any thread can schedule
+	observations without taking a lock; EBN_RunLoopObserverCallBack takes everything that's been scheduled
+	at the start of each drain, and again after each cascade pass. Each take starts a new epoch; an observation 
+	is only queued once per epoch, and its observed object is only retained once per epoch.
+	
+	Observations with a delivery queue go to a per-queue list instead, and get drained on that queue.
+*/
+void EBNScheduleObservation(EBNObservation *observation, NSObject *observed);
+
+/**
+	Returns YES if the given property of baseClass holds values of the type encoded by valueType. Typed immediate
+	observations use this to check that their value type matches their property.
+*/
+BOOL EBNPropertyHasValueType(Class baseClass, NSString *propertyName, const char *valueType);
+
+@class EBNPropertySlotMap;
+
+/**
+	Calls the overridden getter of a synthetic property, forcing the property valid. LazyLoader makes one of these
+	for each getter it overrides, typed for the getter's return type.
+*/
+typedef void (^EBNForceValidThunk)(NSObject *object);
+
 #pragma mark - EBNShadowedClassInfo
 
 /**
@@ -72,9 +92,35 @@ extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
 													// class. Used to ensure no global lazyloads are set up
 													// once alloc is called.
 
-	NSInteger				_validPropertyBitfieldSize;	// Size in bits of the valid properties bitfield--
-														// therefore, the number of properties we can lazyload.
+	NSInteger				_validPropertyBitfieldSize;	// Size in bits of the inline part of the valid properties
+														// bitfield. Properties past this get overflow storage.
 														// NSNotFound until initially determined.
+
+	EBNPropertySlotMap		*_propertySlots;		// Maps observed keys to slots in instances' observation tables
+	Ivar					_observationTableIvar;	// Ivar holding the observation table, for shadow classes
+													// that get additional overrides. NULL otherwise.
+	BOOL					_allSettersSwizzled;	// TRUE once a "*" observation has wrapped the setters of
+													// every property of the base class
+
+	NSDictionary			*_frozenPropertyIndexes;	// Maps property names in _getters to their validity bit
+														// indexes. Set once, when the class is registered;
+														// immutable, so it's read without the sync.
+	NSArray					*_frozenGetters;			// Copy of _getters made along with the frozen index table
+
+		// Dependencies synthetic properties declared on other properties of the same object
+	NSMutableDictionary		*_syntheticDependents;		// Property name -> NSMutableOrderedSet of the synthetic
+														// properties that depend on it directly
+	NSArray					*_frozenTopologicalOrder;	// Validity bit indexes of all of _getters, with every
+														// property after the properties it depends on
+	NSDictionary			*_frozenDependents;			// Property name -> bit indexes of all the properties that
+														// depend on it, directly or not, in topological order
+	ptrdiff_t				_validityIvarOffset;		// Offset of the validity bitfield ivar in instances of
+														// the shadow class. 0 if the class has no bitfield.
+
+	NSMutableArray			*_forceValidThunks;			// EBNForceValidThunks, indexed like _getters. NSNull where
+														// the getter couldn't be overridden.
+	NSArray					*_frozenForceValidThunks;	// Copy of _forceValidThunks made along with the frozen
+														// index table; read without the sync.
 }
 
 	/// An internal initializer used to create EBNShadowedClassInfo objects
@@ -82,14 +128,46 @@ extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
 
 @end
 
+#pragma mark - EBNKeypath
+/**
+	An interned, parsed keypath. There is one of these for each distinct keypath string that has been observed,
+	and every EBNKeypathEntryInfo for an observation of that keypath shares it. Two keypaths are equal exactly when 
+	they're the same object, so compare them with ==. Components are interned as well, so a property name that
+	appears in many keypaths is a single string object.
+	
+	Keypaths are immutable. The intern table holds them weakly, so a keypath is freed once nothing observes it;
+	interning the same string after that makes a new keypath, with a new ID.
+*/
+@interface EBNKeypath : NSObject
+{
+@public
+	NSString				*_string;			// The keypath string, "a.b.c"
+	NSArray<NSString *>		*_components;		// The interned components of the keypath, @[@"a", @"b", @"c"]
+	NSUInteger				_keypathID;			// Unique among keypaths; never 0
+}
+
+	/// Returns the interned keypath for the given string, creating it if necessary.
++ (EBNKeypath *) keypathForString:(NSString *) keypathString;
+
+	/// Returns the interned keypath for the given string, or nil if no live keypath has that string.
++ (EBNKeypath *) existingKeypathForString:(NSString *) keypathString;
+
+	/// The number of components in the keypath.
+@property (readonly) NSUInteger count;
+
+	/// Lets keypath[index] return the component at index.
+- (NSString *) objectAtIndexedSubscript:(NSUInteger) index;
+
+@end
+
 #pragma mark - EBNKeypathEntryInfo
 /**
 	This structure manages internal bookeeping for a single keypath someone is observing.
-	Each object in the observation path has this object in the dictionary for the property of that 
-	object being observed.
-	
-	The ebn_observedKeysDict: dictionary (stored in an associated object for something being observed) maps
-	property names to NSMutableArrays of these objects.
+	Each object in the observation path has this object in its observation table, in the entry list for
+	the property of that object being observed.
+
+	The ebn_observationTable: table (stored in an ivar or associated object of something being observed) maps
+	property names to immutable NSArrays of these objects.
 	
 	This object uses ivars instead of properties for a reason--I don't want for it to be possible to observe on
 	the internal mechanics of observation itself.
@@ -98,7 +176,7 @@ extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
 {
 @public
 	EBNObservation			*_blockInfo;
-	NSArray		 			*_keyPath;
+	EBNKeypath	 			*_keyPath;
 	NSInteger				_keyPathIndex;
 }
 
@@ -158,10 +236,129 @@ extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
 	ObservationBlock 		_copiedBlock;
 	ObservationBlock		_copiedImmedBlock;
 
+		// For typed immediate observations. The typed block takes raw values of the type encoded by _typedImmedValueType;
+		// the boxed block is used for changes where we only have boxed values, or values of some other type.
+	id						_copiedTypedImmedBlock;
+	EBNBoxedImmedBlock		_copiedBoxedImmedBlock;
+	const char				*_typedImmedValueType;
+	NSString				*_typedImmedProperty;
+
+		// The schedule queue epochs this observation was last scheduled in, by a drain thread (the main thread, 
+		// or one running concurrent-safe blocks) and by any other thread. Used to avoid queueing
+		// the observation more than once per drain. Only access with atomic builtins.
+	NSUInteger				_scheduledEpoch;
+	NSUInteger				_otherThreadScheduledEpoch;
+
+		// The drain that last ran this observation's block. Main thread only.
+	NSUInteger				_lastDrainRun;
+	
+		// The drain that last carried this observation over to the next drain. Main thread only.
+	NSUInteger				_lastDrainCarriedOver;
+	
+		// Backs the deliveryQueue property. Set if the delayed block runs on a dispatch queue instead of the main thread.
+	dispatch_queue_t		_deliveryQueue;
+	
+		// Set while the observation is waiting to be run on its delivery queue. Only access with atomic builtins.
+	BOOL					_deliveryPending;
+	
+		// This observation's keypath entries at keypath index 0--the ones in the observed object's table. Holds
+		// the entries weakly, as the table owns them. Guarded by the observer index lock in EBNObservation.m.
+		// Not kept for LazyLoader observations.
+	NSHashTable				*_rootEntries;
 }
 
 + (BOOL) scheduleBlocks:(NSArray<EBNKeypathEntryInfo *> *) blocks;
 
+	/// Runs the boxed block of a typed immediate observation. Checks that the observed and observing objects
+	/// are still around first; returns NO if they aren't.
+- (BOOL) executeBoxedImmedBlockWithPreviousValue:(id) prevValue newValue:(id) newValue;
+
+/**
+	The reverse index. Each observation tracks its root keypath entries, and each observer tracks its observations,
+	so that removing an observer's observations only touches that observer's entries, instead of searching the
+	observed object's entire table. ebn_addEntry: and ebn_removeEntry: keep this up to date.
+*/
+- (void) ebn_addRootEntry:(EBNKeypathEntryInfo *) entryInfo;
+- (void) ebn_removeRootEntry:(EBNKeypathEntryInfo *) entryInfo;
+
+	/// Stops observing the keypaths this observation has on its observed object that match keyPath, or all of them
+	/// if keyPath is nil. Returns the number of keypaths removed.
+- (NSUInteger) ebn_stopObservingKeypath:(EBNKeypath *) keyPath;
+
+	/// Returns the (non-LazyLoader) observations whose observer is the given object, and which have at least one
+	/// keypath entry in their observed object.
++ (NSArray<EBNObservation *> *) ebn_observationsForObserver:(id) observer;
+
+@end
+
+#pragma mark - EBNPropertySlotMap
+/**
+	Assigns small integer slots to the keys (property names, "*", collection keys) observed on instances of a class.
+	Each shadowed class has one of these; observation tables for instances of the class store their entry lists
+	in an array indexed by slot. The "*" key is always slot 0. Slots are assigned the first time a key is observed
+	on any instance of the class, and are never reassigned.
+
+	Setter overrides look up their property's slot once when they're created, and keep it.
+*/
+@interface EBNPropertySlotMap : NSObject
+
+	/// Returns the slot for the given key. Returns NSNotFound if the key has no slot and create is NO.
+- (NSInteger) slotForKey:(NSString *) key create:(BOOL) create;
+
+	/// Returns the key assigned to the given slot.
+- (NSString *) keyForSlot:(NSInteger) slot;
+
+	/// Notes that an object whose class uses this map has an observation table made with some other map. The map's
+	/// observed counts no longer cover every table its class's instances might have.
+- (void) noteForeignTable;
+
+@end
+
+#pragma mark - EBNObservationTable
+/**
+	Each observed object has one of these, mapping the keys (usually property names) being observed on the object
+	to the EBNKeypathEntryInfo objects for the keypaths that observe them. Keys are mapped to slots with the
+	EBNPropertySlotMap for the object's class, and the table stores a list per slot.
+
+	The table is copy-on-write. The entry list for each key is an immutable NSArray that is never mutated
+	once it's published; adding or removing an entry builds a new table snapshot and publishes it with a single
+	atomic store. Readers (the swizzled setters, mostly) take a snapshot with one atomic load, and don't
+	allocate or lock. Snapshots that get replaced while readers may still be iterating them are retired,
+	and freed once there are no active readers.
+
+	Mutations serialize on @synchronized(table). Code that needs to read several keys and then mutate
+	based on what it read can sync on the table to keep other writers out while it works.
+*/
+@interface EBNObservationTable : NSObject
+
+	/// Creates a table whose keys are mapped to slots using slotMap
+- (instancetype) initWithSlotMap:(EBNPropertySlotMap *) slotMap;
+
+	/// The slot map the table was made with.
+- (EBNPropertySlotMap *) slotMap;
+
+	/// Returns the current, immutable list of entries observing the given key, or nil if nothing is.
+- (NSArray<EBNKeypathEntryInfo *> *) entriesForKey:(NSString *) key;
+
+	/// Returns all the keys that currently have at least one entry.
+- (NSArray<NSString *> *) allKeys;
+
+	/// Adds the given entry to the list for the given key. Returns YES if the key wasn't being observed before.
+- (BOOL) addEntry:(EBNKeypathEntryInfo *) entryInfo forKey:(NSString *) key;
+
+	/// Removes one entry matching entryInfo's observation and keypath at the given path index. Sets keyRemoved
+	/// to YES if the key has no entries left afterwards. Returns the removed entry, or nil if none matched.
+- (EBNKeypathEntryInfo *) removeEntry:(EBNKeypathEntryInfo *) entryInfo atIndex:(NSInteger) pathIndex
+		forKey:(NSString *) key keyRemoved:(BOOL *) keyRemoved;
+
+	/// Moves the entry lists for each of fromKeys to the corresponding key in toKeys, publishing the result
+	/// as a single change. Used by the array classes when an insert or remove shifts the observed indexes.
+- (void) moveEntriesForKeys:(NSArray<NSString *> *) fromKeys toKeys:(NSArray<NSString *> *) toKeys;
+
+	/// Stamps the table with the given schedule queue epoch. Returns NO if it was already stamped with that epoch,
+	/// meaning the table's object is already being kept alive for that epoch's drain.
+- (BOOL) markKeepAliveForEpoch:(NSUInteger) epoch;
+
 @end
 
 #pragma mark - EBNObservable_Custom_Selectors
@@ -191,13 +388,13 @@ extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
 
 /**
 	This is how Observable gets at the list of methods that are being observed.
-	
-	The returned dictionary is keyed on the properties currently being observed, and each key's value is a set
+
+	The returned table is keyed on the properties currently being observed, and each key's value is a list
 	of all the observations active on that property.
 
-	@return A dictionary containing sub-dictionaries for each method which has an active observation.
+	@return The receiver's observation table, or nil if it has none and createIfNil is NO.
  */
-- (NSMutableDictionary *) ebn_observedKeysDict:(BOOL) createIfNil;
+- (EBNObservationTable *) ebn_observationTable:(BOOL) createIfNil;
 
 	// When setting up an observation, or when an object in the middle of a keypath changes value, these
 	// methods are used to set up observations on each object in the key path except for the endoint property.
@@ -251,6 +448,12 @@ extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
  */
 - (void) ebn_markPropertyValid:(NSString *) property;
 
+/**
+	Frees the overflow storage of the receiver's synthetic property validity bitfield, if it has any. 
+	Only dealloc should call this.
+*/
+- (void) ebn_freeValidityOverflow;
+
 /**
 	Returns a set of all properties of self, as an array of strings.
 */
@@ -280,10 +483,29 @@ extern NSMutableArray 			*EBN_ObservedObjectBeingDrainedKeepAlive;
 /// This function dumps all methods that have been set up for observation in all classes
 NSString *ebn_debug_DumpAllObservedMethods(void);
 
-// Utility functions for finding property getters and setter selectors
+// Utility functions for finding property getters and setter selectors. Results are cached per (class, property).
 SEL ebn_selectorForPropertyGetter(Class baseClass, NSString * propertyName);
 SEL ebn_selectorForPropertySetter(Class baseClass, NSString * propertyName);
 
+/**
+	Call this after replacing a property accessor method on a class. Cached accessors for that class and its
+	subclasses get resolved again the next time they're used.
+*/
+void EBNInvalidateAccessorCache(Class modifiedClass);
+
+/**
+	Returns the names of all the properties of the given class and its superclasses, up to NSObject. The set is
+	built the first time it's asked for, and the same set object is returned for the class from then on.
+*/
+NSSet<NSString *> *EBNAllPropertiesForClass(Class baseClass);
+
+/**
+	Marks a property of object valid with a single atomic OR, without locking. PropIndex is the property's
+	validity bit index if the caller knows it, or NSNotFound to look it up in info's frozen index table.
+	Object must be an instance of info's shadow class (or a runtime subclass of it).
+*/
+void EBNMarkPropertyValid(NSObject *object, EBNShadowedClassInfo *info, NSInteger propIndex, NSString *propName);
+
 /**
 	Returns YES if this is a DEBUG build and there is a debugger attached. Will always return NO on
 	other build types, even if there IS a debugger attached. 
@@ -356,3 +578,128 @@ BOOL EBNIsADebuggerConnected(void);
 	}
 #endif
 
+#if defined(__cplusplus)
+
+#import <atomic>
+#import <vector>
+
+/**
+	Calls a getter and boxes its result into an object. There's one of these for each getter return type
+	that ebn_valueForKey: handles; key is only used by thunks that fall back to valueForKey:.
+*/
+typedef id (*EBNGetterThunk)(id self, SEL getterSEL, IMP getterIMP, NSString *key);
+
+/**
+	The resolved getter and setter of a property of some class. Any of these may be nil/NULL, if the class doesn't
+	have that accessor. Type encodings are the full method type encodings.
+*/
+struct EBNPropertyAccessors
+{
+	SEL				_getterSEL;
+	IMP				_getterIMP;
+	const char		*_getterTypeEncoding;
+	EBNGetterThunk	_getterThunk;			// Boxes the getter's result, for ebn_valueForKey:
+
+	SEL				_setterSEL;
+	IMP				_setterIMP;
+	const char		*_setterTypeEncoding;
+
+	const char		*_propertyType;			// The type encoding from the property's "T" attribute. Interned; never freed.
+};
+
+/**
+	Returns the accessors for the given property of the given class. Lookups after the first are a hash table 
+	lookup under a read lock.
+*/
+EBNPropertyAccessors EBNAccessorsForProperty(Class baseClass, NSString *propertyName);
+
+/**
+	An observation taken from the schedule queue. scheduledByDrain is set if it was scheduled from the main
+	thread, or from a thread running concurrent-safe blocks for a drain.
+*/
+struct EBNTakenObservation
+{
+	EBNObservation		*_observation;
+	bool				_scheduledByDrain;
+};
+
+/**
+	Empties the schedule queue, appending the scheduled observations to observations. Observed objects
+	that need to be kept alive until the observations run are appended to keepAlive, which is created if nil.
+	Returns false if nothing was scheduled.
+*/
+bool EBNTakeScheduledObservations(std::vector<EBNTakenObservation> &observations, NSMutableArray * __strong *keepAlive);
+
+/**
+	Marks the current thread as running concurrent-safe blocks for a drain, or clears the mark.
+*/
+void EBNSetDrainWorkerThread(bool isDrainWorker);
+
+/****************************************************************************************************
+	EBNObserverSnapshot
+
+	A stack-only reader for an EBNObservationTable. Constructing one takes a snapshot of the entries
+	observing the given key (and optionally the "*" key) with a single atomic load, no locks, and no
+	allocations. Setter overrides pass the slot they looked up when they were created, along with the
+	slot map that slot came from; other callers pass just the key, which costs a slot lookup. The snapshot's lists stay valid--even if other threads, or the observer blocks being run,
+	add or remove observations--until the snapshot is destroyed.
+
+	Keep these short-lived, and don't store them anywhere. Retired table snapshots can't be freed while
+	any reader is active on the table.
+*/
+class EBNObserverSnapshot
+{
+public:
+	EBNObserverSnapshot(EBNObservationTable *table, NSString *key, bool includeWildcard);
+	EBNObserverSnapshot(EBNObservationTable *table, EBNPropertySlotMap *slotMap, NSInteger slot, NSString *key);
+	~EBNObserverSnapshot();
+
+	EBNObserverSnapshot(const EBNObserverSnapshot &) = delete;
+	EBNObserverSnapshot &operator=(const EBNObserverSnapshot &) = delete;
+
+	bool isEmpty() const { return !_entries && !_wildcardEntries; }
+	NSUInteger count() const { return _entries.count + _wildcardEntries.count; }
+
+		// Calls func with each entry for the key, then each entry for "*".
+	template<typename Func> void forEachEntry(Func func) const
+	{
+		for (EBNKeypathEntryInfo *entry in _entries)
+			func(entry);
+		for (EBNKeypathEntryInfo *entry in _wildcardEntries)
+			func(entry);
+	}
+
+private:
+	void begin(EBNObservationTable *table, NSInteger slot, bool includeWildcard);
+
+	EBNObservationTable 					*_table;		// Non-nil while this reader is active
+	NSArray * __unsafe_unretained			_entries;
+	NSArray * __unsafe_unretained			_wildcardEntries;
+};
+
+/****************************************************************************************************
+	EBNSlotObservedCounts
+
+	Each slot map counts, per slot, how many of the tables using it have observers in that slot. Setters of
+	classes whose instances keep their table in an associated object grab the counts for their property's
+	slot when they're created; when no instance of the class is observing the property or "*", the setter
+	can skip looking the table up. The pointers stay valid for the life of the slot map (which is forever, for
+	shadow classes).
+*/
+struct EBNSlotObservedCounts
+{
+	const std::atomic<NSInteger>			*_propertyTableCount;
+	const std::atomic<NSInteger>			*_wildcardTableCount;
+	const std::atomic<bool>					*_hasForeignTables;
+
+		// False if no table using the map can have observers for the slot
+	bool mayHaveObservers() const
+	{
+		return _propertyTableCount->load() || _wildcardTableCount->load() || _hasForeignTables->load();
+	}
+};
+
+EBNSlotObservedCounts EBNSlotMapObservedCounts(EBNPropertySlotMap *slotMap, NSInteger slot);
+
+#endif
+
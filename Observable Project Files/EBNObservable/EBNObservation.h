@@ -90,6 +90,31 @@
  */
 typedef void (^ObservationBlock)(id _Nonnull observingObj, id _Nonnull observedObj);
 
+/**
+	The boxed form of a typed immediate observation block; see EBNObserveImmedTyped(). Gets called when 
+	a typed immediate observation needs to deliver values that only exist boxed, or whose type doesn't
+	match the type the block was created with.
+
+	@param observingObj  The object getting notified of changes
+	@param observedObj   The object being watched
+	@param previousValue The previous value of the property, boxed into an object
+	@param newValue      The new value of the property, boxed into an object
+*/
+typedef void (^EBNBoxedImmedBlock)(id _Nonnull observingObj, id _Nonnull observedObj, id _Nullable previousValue,
+		id _Nullable newValue);
+
+
+/**
+	Priorities for delayed observations. When a drain time budget is set (see EBNSetDrainTimeBudget()), delayed
+	blocks run in priority order, and blocks that don't fit in the budget are carried over to the next runloop pass.
+	VisibleUI blocks always run, regardless of the budget.
+*/
+typedef NS_ENUM(NSInteger, EBNObservationPriority)
+{
+	EBNObservationPriorityNormal = 0,		// The default
+	EBNObservationPriorityVisibleUI,		// Runs first, and is never carried over
+	EBNObservationPriorityBackground,		// Runs last, and is the first to get carried over
+};
 
 /**
 	This object encapsulates a single observation that can be applied to keypaths to observe things.
@@ -125,6 +150,24 @@ typedef void (^ObservationBlock)(id _Nonnull observingObj, id _Nonnull observedO
 	/// the breakpoint. This lets you break just before these blocks so you can debug through them.
 	@property (assign) BOOL				willDebugBreakOnInvoke;
 
+	/// Sets when this observation's delayed block runs relative to other delayed blocks. Only matters when
+	/// a drain time budget is set. Defaults to EBNObservationPriorityNormal. Ignored for immediate blocks.
+@property (assign) EBNObservationPriority	priority;
+
+	/// Makes this observation's delayed block run on the given dispatch queue instead of the main thread. Blocks 
+	/// scheduled for the same queue are coalesced, and drained together by one block dispatched to the queue; each 
+	/// observation runs at most once per drain, and observed objects are kept alive until their blocks run.
+	/// Can be a serial queue or a concurrent (global) queue; in either case the block isn't called on the main thread
+	/// unless the queue is the main queue. Set this before calling observe:. Defaults to nil, meaning the main thread.
+@property (strong, nullable) dispatch_queue_t	deliveryQueue;
+
+	/// Marks this observation's delayed block as safe to run on any thread, concurrently with other blocks.
+	/// Main thread drains run all the concurrent-safe blocks they find at once, spread across cores, and wait for 
+	/// them to finish before running other blocks. Only set this for blocks that don't touch UI and don't depend
+	/// on other blocks having run first--blocks that invalidate caches, for instance. Concurrent-safe blocks
+	/// ignore priority and the drain time budget.
+@property (assign) BOOL					isConcurrentSafe;
+
 
 /**
 	Initializes a EBNObservation, for use with the given observed and observer objects.
@@ -150,6 +193,23 @@ typedef void (^ObservationBlock)(id _Nonnull observingObj, id _Nonnull observedO
 - (nullable instancetype) initForObserved:(nullable NSObject *) observed observer:(nullable id) observer
 		immedBlock:(nullable ObservationBlock) callBlock;
 
+/**
+	Initializes a typed immediate EBNObservation. Use EBNObserveImmedTyped() instead of calling this directly.
+
+	@param observed     The object being watched
+	@param observer     The object doing the watching
+	@param propertyName The property of observed that will be observed
+	@param typedBlock   A block taking the raw previous and new values of the property, which must have the type
+						described by valueType
+	@param boxedBlock   A block that does the same thing as typedBlock, but takes boxed values
+	@param valueType    The @encode() string for the value type typedBlock takes
+
+	@return an EBNObservation object
+ */
+- (nullable instancetype) initForObserved:(nullable NSObject *) observed observer:(nullable id) observer
+		property:(nonnull NSString *) propertyName typedImmedBlock:(nonnull id) typedBlock
+		boxedBlock:(nonnull EBNBoxedImmedBlock) boxedBlock valueType:(nonnull const char *) valueType;
+
 /**
 	Tells the receiver to begin observing changes to the given keypath.
 
@@ -174,6 +234,15 @@ typedef void (^ObservationBlock)(id _Nonnull observingObj, id _Nonnull observedO
 */
 - (void) stopObservations;
 
+/**
+	Ends the receiver's observation of the given keypath, leaving any other keypaths it observes alone.
+	The receiver keeps track of the keypath entries it created, so this doesn't search the observed
+	object's observations, and won't affect other observations of the same keypath.
+
+	@param keyPath A keypath the receiver was asked to observe.
+*/
+- (void) stopObserving:(nonnull NSString *) keyPath;
+
 /**
 	Transforms a delayed-mode observation into an immediate-mode one. Use this if you need to receive
 	observation callbacks on the thread where the change happens.
@@ -295,5 +364,89 @@ EBNObservation * _Nullable ObserveImmedDebug(id _Nonnull observer, id _Nonnull o
 	__attribute__((unavailable));
 #endif
 
+#if defined(__cplusplus)
+
+/**
+	EBNUnwrapValue converts a value boxed into an NSNumber or NSValue back into a T. Used by typed immediate
+	observations for changes that arrive boxed. Values that can't be converted come back as T().
+	
+	NSValue's getValue: copies as many bytes as the boxed type holds, so only unbox values whose type is exactly T.
+*/
+template<typename T> inline T EBNUnwrapValue(id _Nullable value)
+{
+	T result = T();
+	if ([value isKindOfClass:[NSValue class]] && !strcmp([(NSValue *) value objCType], @encode(T)))
+		[(NSValue *) value getValue:&result];
+	return result;
+}
+
+template<> inline id _Nullable EBNUnwrapValue<id>(id _Nullable value) 			{ return value; }
+template<> inline Class _Nullable EBNUnwrapValue<Class>(id _Nullable value) 	{ return (Class) value; }
+
+#define EBNUnwrapNumber(valueType, accessor) \
+	template<> inline valueType EBNUnwrapValue<valueType>(id _Nullable value) \
+	{ \
+		return [value isKindOfClass:[NSNumber class]] ? [(NSNumber *) value accessor] : valueType(); \
+	}
+
+EBNUnwrapNumber(bool, boolValue)
+EBNUnwrapNumber(char, charValue)
+EBNUnwrapNumber(unsigned char, unsignedCharValue)
+EBNUnwrapNumber(short, shortValue)
+EBNUnwrapNumber(unsigned short, unsignedShortValue)
+EBNUnwrapNumber(int, intValue)
+EBNUnwrapNumber(unsigned int, unsignedIntValue)
+EBNUnwrapNumber(long, longValue)
+EBNUnwrapNumber(unsigned long, unsignedLongValue)
+EBNUnwrapNumber(long long, longLongValue)
+EBNUnwrapNumber(unsigned long long, unsignedLongLongValue)
+EBNUnwrapNumber(float, floatValue)
+EBNUnwrapNumber(double, doubleValue)
+
+#undef EBNUnwrapNumber
+
+/**
+	The type of block used for typed immediate observations. Gets the raw previous and new values of the property.
+*/
+template<typename T> using EBNTypedImmedBlock = void (^)(id _Nonnull observingObj, id _Nonnull observedObj,
+		T previousValue, T newValue);
+
+/**
+	Creates an immediate observation on one property of observedObj. Instead of a plain ObservationBlock, block gets 
+	passed the previous and new values of the property, typed as T. T must be the property's type, which gets checked
+	when the observation is created.
+	
+	When the property's setter changes the value, the values are handed from the setter to the block without
+	boxing them into objects, so this is suitable for properties that change very often. Changes that are only 
+	known in boxed form (manual triggers, for instance) get unboxed into T first.
+	
+	Like other immediate observations, block gets called on the thread that changed the property, inside the setter.
+
+		EBNObserveImmedTyped<CGFloat>(self, scrollModel, @"offset",
+				^(MyViewController *blockSelf, ScrollModel *observed, CGFloat previousValue, CGFloat newValue)
+				{
+					...
+				});
 
+	@param observer     The object doing the observing, usually 'self'.
+	@param observedObj  The object to observe.
+	@param propertyName The name of a property of observedObj. Cannot be a keypath.
+	@param block        The block to invoke with the previous and new values when the property changes value.
 
+	@return The newly created EBNObservation.
+*/
+template<typename T> EBNObservation * _Nullable EBNObserveImmedTyped(id _Nonnull observer, NSObject * _Nonnull observedObj,
+		NSString * _Nonnull propertyName, EBNTypedImmedBlock<T> _Nonnull block)
+{
+	EBNBoxedImmedBlock boxedBlock = ^(id _Nonnull observingObj, id _Nonnull observedObject, id _Nullable previousValue,
+			id _Nullable newValue)
+	{
+		block(observingObj, observedObject, EBNUnwrapValue<T>(previousValue), EBNUnwrapValue<T>(newValue));
+	};
+	
+	EBNObservation *observation = [[EBNObservation alloc] initForObserved:observedObj observer:observer
+			property:propertyName typedImmedBlock:block boxedBlock:boxedBlock valueType:@encode(T)];
+	return [observation observe:propertyName];
+}
+
+#endif
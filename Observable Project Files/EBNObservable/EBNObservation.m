@@ -9,11 +9,60 @@
 
 #import <objc/runtime.h>
 #import <libgen.h>
+#import <pthread.h>
 
 #import "EBNObservation.h"
 #import "EBNObservableInternal.h"
 
 
+	// Each observer gets a sentinel holding a weak hash table of its observations, as an associated object.
+	// The lock guards all of the hash tables, along with each observation's root entries, so that an
+	// observation's first and last root entries update its observer's table atomically.
+static pthread_mutex_t		EBNObserverIndexLock = PTHREAD_MUTEX_INITIALIZER;
+static char					EBNObserverIndexKey;
+
+/**
+	The sentinel is attached to an observer as an associated object, so it gets deallocated when the observer does.
+	At that point it stops all the observer's observations, unlinking their keypath entries from every object
+	they touch. This way setters don't carry dead entries around until something reaps them.
+*/
+@interface EBNObserverSentinel : NSObject
+{
+@public
+	NSHashTable<EBNObservation *>	*_observations;
+}
+@end
+
+@implementation EBNObserverSentinel
+
+- (instancetype) init
+{
+	if (self = [super init])
+	{
+		_observations = [NSHashTable weakObjectsHashTable];
+	}
+	return self;
+}
+
+/****************************************************************************************************
+	dealloc
+	
+	The observer is going away. Its weak references are already nil, so the observations can't run.
+*/
+- (void) dealloc
+{
+	pthread_mutex_lock(&EBNObserverIndexLock);
+	NSArray *observations = [_observations allObjects];
+	pthread_mutex_unlock(&EBNObserverIndexLock);
+
+	for (EBNObservation *observation in observations)
+	{
+		[observation ebn_stopObservingKeypath:nil];
+	}
+}
+
+@end
+
 @implementation EBNObservation
 
 
@@ -24,34 +73,28 @@
 	
 	Schedules multiple blocks to be run at the end of the current runloop. 
 	
-	This method should act similarly but be more efficient than calling schedule on each block
-	in a for loop. This method only takes the sync once.
+	This method should act similarly to calling schedule on each block in a for loop. Scheduling
+	doesn't lock, so this is safe to call from any thread without contending with other threads.
 	
 	Returns TRUE if any of the blocks couldn't be scheduled because their observed object has been
-	deallocated, in which case the
+	deallocated, in which case the caller should reap blocks.
 */
 + (BOOL) scheduleBlocks:(NSArray<EBNKeypathEntryInfo *> *) blocks
 {
-	// Adding blocks to the global collections of "run later" blocks must be done inside
-	// the sync. The sync is outside the loop for speed.
 	BOOL reapAfterIterating = NO;
-	@synchronized(EBNObservableSynchronizationToken)
+	for (EBNKeypathEntryInfo *entry in blocks)
 	{
-		for (EBNKeypathEntryInfo *entry in blocks)
+		EBNObservation *blockInfo = entry->_blockInfo;
+		if (blockInfo->_copiedBlock)
 		{
-			EBNObservation *blockInfo = entry->_blockInfo;
-			if (blockInfo->_copiedBlock)
+			NSObject *strongObserved = blockInfo->_weakObserved;
+			if (strongObserved)
 			{
-				NSObject *strongObserved = blockInfo->_weakObserved;
-				if (strongObserved)
-				{
-					[EBN_ObserverBlocksToRunAfterThisEvent addObject:blockInfo];
-					[EBN_ObservedObjectKeepAlive addObject:strongObserved];
-				}
-				else
-				{
-					reapAfterIterating = YES;
-				}
+				EBNScheduleObservation(blockInfo, strongObserved);
+			}
+			else
+			{
+				reapAfterIterating = YES;
 			}
 		}
 	}
@@ -97,6 +140,35 @@
 	return self;
 }
 
+/****************************************************************************************************
+	initForObserved:observer:property:typedImmedBlock:boxedBlock:valueType:
+	
+	Creates a typed immediate observation. The typed block is called directly from the setter of the observed
+	property, with raw values. The boxed block calls the typed block after unboxing its arguments, and is
+	used for other sorts of changes. The block's value type must match the property's type.
+*/
+- (instancetype) initForObserved:(NSObject *) observed observer:(id) observer
+		property:(NSString *) propertyName typedImmedBlock:(id) typedBlock
+		boxedBlock:(EBNBoxedImmedBlock) boxedBlock valueType:(const char *) valueType
+{
+	EBAssert(EBNPropertyHasValueType([observed class], propertyName, valueType),
+			@"Typed immediate observation of %@ on class %@ takes values of type %s, which isn't the property's type.",
+			propertyName, [observed class], valueType);
+
+	if (self = [super init])
+	{
+		_weakObserved = observed;
+		_weakObserver = observer;
+		_weakObserver_forComparisonOnly = observer;
+		_copiedTypedImmedBlock = [typedBlock copy];
+		_copiedBoxedImmedBlock = [boxedBlock copy];
+		_typedImmedValueType = valueType;
+		_typedImmedProperty = [propertyName copy];
+	}
+	
+	return self;
+}
+
 /****************************************************************************************************
 	makeImmediateMode
     
@@ -120,11 +192,18 @@
 	
 	result.debugString = self.debugString;
 	result.isForLazyLoader = self.isForLazyLoader;
+	result.priority = self.priority;
+	result.deliveryQueue = self.deliveryQueue;
+	result.isConcurrentSafe = self.isConcurrentSafe;
 	result->_weakObserved = _weakObserved;
 	result->_weakObserver = _weakObserver;
 	result->_weakObserver_forComparisonOnly = _weakObserver_forComparisonOnly;
 	result->_copiedBlock = _copiedBlock;
 	result->_copiedImmedBlock = _copiedImmedBlock;
+	result->_copiedTypedImmedBlock = _copiedTypedImmedBlock;
+	result->_copiedBoxedImmedBlock = _copiedBoxedImmedBlock;
+	result->_typedImmedValueType = _typedImmedValueType;
+	result->_typedImmedProperty = _typedImmedProperty;
 	
 	return result;
 }
@@ -170,46 +249,130 @@
 
 	Deregisters all observation keypaths that this observation block was given.
 	
-	Deregistering observations is ALWAYS done by searching for observations that match criteria, and all
-	observations that match the given criteria will be removed.
-	
-	Must be sent to the same object that you sent the "tell:" method to when you set up the observation,
-	but matches any keypath. That is, this won't remove an observation whose keypath goes through or
-	ends at this object, only ones that start at this object.
+	Uses the reverse index, so this only touches this observation's own keypath entries.
 */
 - (void) stopObservations
 {
-	NSObject *blockObserved = _weakObserved;
-	if (!blockObserved)
-		return;
+	[self ebn_stopObservingKeypath:nil];
+}
+
+/****************************************************************************************************
+	stopObserving:
+	
+	Ends the observation of one keypath. A keypath that was never interned can't be one we're observing.
+*/
+- (void) stopObserving:(NSString *) keyPath
+{
+	EBNKeypath *internedKeypath = [EBNKeypath existingKeypathForString:keyPath];
+	if (internedKeypath)
+		[self ebn_stopObservingKeypath:internedKeypath];
+}
 
-	NSMutableSet *entriesToRemove = [[NSMutableSet alloc] init];
+#pragma mark Reverse Index
+
+/****************************************************************************************************
+	ebn_addRootEntry:
+	
+	Called when an entry for this observation gets added to the observed object's table at keypath index 0.
+	The first root entry registers this observation with its observer, attaching a sentinel to the observer
+	if it doesn't have one yet.
+*/
+- (void) ebn_addRootEntry:(EBNKeypathEntryInfo *) entryInfo
+{
+	if (self.isForLazyLoader)
+		return;
+	
+	id observer = _weakObserver;
+	pthread_mutex_lock(&EBNObserverIndexLock);
+	if (!_rootEntries)
+	{
+		_rootEntries = [NSHashTable hashTableWithOptions:NSPointerFunctionsWeakMemory |
+				NSPointerFunctionsObjectPointerPersonality];
+	}
+	BOOL isFirstEntry = _rootEntries.count == 0;
+	[_rootEntries addObject:entryInfo];
+	
+	if (isFirstEntry && observer)
+	{
+		EBNObserverSentinel *sentinel = objc_getAssociatedObject(observer, &EBNObserverIndexKey);
+		if (!sentinel)
+		{
+			sentinel = [[EBNObserverSentinel alloc] init];
+			objc_setAssociatedObject(observer, &EBNObserverIndexKey, sentinel, OBJC_ASSOCIATION_RETAIN);
+		}
+		[sentinel->_observations addObject:self];
+	}
+	pthread_mutex_unlock(&EBNObserverIndexLock);
+}
 
-	NSMutableDictionary *observedKeysDict = [blockObserved ebn_observedKeysDict:NO];
-	if (observedKeysDict)
+/****************************************************************************************************
+	ebn_removeRootEntry:
+	
+	Called when an entry for this observation gets removed from the observed object's table at keypath 
+	index 0. When the last root entry goes, this observation leaves its observer's list, unless the observer
+	is being deallocated (in which case the list is about to go away anyway).
+*/
+- (void) ebn_removeRootEntry:(EBNKeypathEntryInfo *) entryInfo
+{
+	id observer = _weakObserver;
+	pthread_mutex_lock(&EBNObserverIndexLock);
+	if (_rootEntries)
 	{
-		@synchronized(observedKeysDict)
+		[_rootEntries removeObject:entryInfo];
+		if (_rootEntries.count == 0 && observer)
 		{
-			for (NSString *propertyKey in [observedKeysDict allKeys])
-			{
-				NSMutableArray *observers = observedKeysDict[propertyKey];
-				
-				for (EBNKeypathEntryInfo *entryInfo in observers)
-				{
-					// Match on the entries where the block that gets run is the indicated block
-					if (entryInfo->_blockInfo == self && entryInfo->_keyPathIndex == 0)
-					{
-						[entriesToRemove addObject:entryInfo];
-					}
-				}
-			}
+			EBNObserverSentinel *sentinel = objc_getAssociatedObject(observer, &EBNObserverIndexKey);
+			[sentinel->_observations removeObject:self];
 		}
 	}
+	pthread_mutex_unlock(&EBNObserverIndexLock);
+}
+
+/****************************************************************************************************
+	ebn_stopObservingKeypath:
 	
-	for (EBNKeypathEntryInfo *entryInfo in entriesToRemove)
+	Removes the root entries matching keyPath (or all of them, if keyPath is nil), which removes their
+	keypaths from every object along the path. Only looks at this observation's own entries.
+*/
+- (NSUInteger) ebn_stopObservingKeypath:(EBNKeypath *) keyPath
+{
+	NSObject *blockObserved = _weakObserved;
+	if (!blockObserved)
+		return 0;
+	
+	pthread_mutex_lock(&EBNObserverIndexLock);
+	NSArray *rootEntries = [_rootEntries allObjects];
+	pthread_mutex_unlock(&EBNObserverIndexLock);
+	
+	NSUInteger removedCount = 0;
+	for (EBNKeypathEntryInfo *entryInfo in rootEntries)
 	{
-		[entryInfo ebn_updateKeypathAtIndex:0 from:self to:nil];
+		if (!keyPath || entryInfo->_keyPath == keyPath)
+		{
+			[entryInfo ebn_updateKeypathAtIndex:0 from:blockObserved to:nil];
+			++removedCount;
+		}
 	}
+	
+	return removedCount;
+}
+
+/****************************************************************************************************
+	ebn_observationsForObserver:
+	
+	Works while observer is being deallocated, as long as it hasn't finished.
+*/
++ (NSArray<EBNObservation *> *) ebn_observationsForObserver:(id) observer
+{
+	if (!observer)
+		return nil;
+	
+	pthread_mutex_lock(&EBNObserverIndexLock);
+	EBNObserverSentinel *sentinel = objc_getAssociatedObject(observer, &EBNObserverIndexKey);
+	NSArray *observations = [sentinel->_observations allObjects];
+	pthread_mutex_unlock(&EBNObserverIndexLock);
+	
+	return observations;
 }
 
 #pragma mark Running the Observation Blocks
@@ -220,9 +383,11 @@
 	If this is a 'normal' observation with delayed-fire mechanics, runs the block immediately.
 	Checks that the observed and observing object are still around first.
 	
-	Note that many blocks are written to assume they'll only be run on the main thread, and that they
-	won't be run re-entrantly on it either. Calling this method in a way that violates those assumptions
-	is an error.
+	Drains call this on the main thread, except for observations with a deliveryQueue, which get called on
+	that queue (one drain at a time, even on a concurrent queue), and concurrent-safe observations, which
+	main thread drains may call on worker threads. Many blocks are written to assume they'll only be run on
+	the thread their observation says, and that they won't be run re-entrantly there either. Calling this
+	method in a way that violates those assumptions is an error.
 	
 	Returns self (the EBNObservation object), unless we find that the observer or observed objects have
 	been dealloc'ed, in which case we return nil.
@@ -291,11 +456,7 @@
 		NSObject *strongObserved = _weakObserved;
 		if (strongObserved)
 		{
-			@synchronized(EBNObservableSynchronizationToken)
-			{
-				[EBN_ObserverBlocksToRunAfterThisEvent addObject:self];
-				[EBN_ObservedObjectKeepAlive addObject:strongObserved];
-			}
+			EBNScheduleObservation(self, strongObserved);
 		}
 		else
 		{
@@ -349,10 +510,43 @@
 			_copiedImmedBlock(blockObserver, blockObserved);
 		}
 	}
+	else if (_copiedBoxedImmedBlock)
+	{
+		// Typed immediate blocks called from here get boxed values; get the new value from the property
+		NSObject *blockObserved = _weakObserved;
+		observationIsValid = [self executeBoxedImmedBlockWithPreviousValue:prevValue
+				newValue:[blockObserved ebn_valueForKey:_typedImmedProperty]];
+	}
 	
 	return observationIsValid;
 }
 
+/****************************************************************************************************
+	executeBoxedImmedBlockWithPreviousValue:newValue:
+	
+	Runs the boxed block of a typed immediate observation.
+	Checks that the observed and observing object are still around first.
+*/
+- (BOOL) executeBoxedImmedBlockWithPreviousValue:(id) prevValue newValue:(id) newValue
+{
+	NSObject *blockObserved = _weakObserved;
+	id blockObserver = _weakObserver;
+	if (!blockObserved || !blockObserver)
+		return NO;
+
+	if (_willDebugBreakOnInvoke && EBNIsADebuggerConnected())
+	{
+		EBLogStdOut(@"debugBreakOnInvoke breakpoint hit! %@", _debugString.length ? _debugString : @"");
+
+		// This line will cause a break in the debugger! If you stop here in the debugger, it is
+		// because someone set debugBreakOnInvoke on this observation and it's about to invoked.
+		DEBUG_BREAKPOINT;
+	}
+	
+	_copiedBoxedImmedBlock(blockObserver, blockObserved, prevValue, newValue);
+	return YES;
+}
+
 /****************************************************************************************************
 	executeWithPreviousValue:
 	
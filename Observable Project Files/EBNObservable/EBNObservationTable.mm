@@ -0,0 +1,654 @@
+/****************************************************************************************************
+	EBNObservationTable.mm
+	Observable
+
+	Created by Chall Fry on 4/2/18.
+	Copyright (c) 2013-2018 eBay Software Foundation.
+*/
+
+#import <atomic>
+#import <deque>
+#import <vector>
+#import <pthread.h>
+
+#import "EBNObservableInternal.h"
+
+
+/**
+	One published state of an observation table. Lists are indexed by slot; slots with no observers are nil.
+	The vector is only as long as the highest observed slot + 1, so a slot past the end means no observers.
+	Never mutated once published.
+*/
+struct EBNObservationTableSnapshot
+{
+	std::vector<NSArray *>		lists;
+	NSUInteger					numObservedKeys;
+};
+
+@interface EBNObservationTable ()
+{
+@public
+		// Maps keys to slots. Usually the slot map of the observed object's shadow class.
+	EBNPropertySlotMap								*_slotMap;
+
+		// The current table snapshot; nullptr when nothing is being observed.
+	std::atomic<EBNObservationTableSnapshot *>		_currentSnapshot;
+
+		// Count of readers that may be looking at a table snapshot right now.
+	std::atomic<NSInteger>							_activeReaders;
+
+		// Snapshots that have been replaced, but that a reader could still be iterating.
+		// Guarded by @synchronized(self); the flag lets readers check for them without taking the sync.
+	std::vector<EBNObservationTableSnapshot *>		_retiredSnapshots;
+	std::atomic<bool>								_hasRetiredSnapshots;
+
+		// The last schedule queue epoch in which our object was retained for a drain
+	std::atomic<NSUInteger>							_keepAliveEpoch;
+}
+
+- (void) ebn_reclaimRetiredSnapshots;
+
+@end
+
+@interface EBNPropertySlotMap ()
+{
+@public
+		// Guards the key/slot mappings, and the size of _tableCounts
+	pthread_rwlock_t								_slotLock;
+
+		// For each slot, the number of tables using this map that have observers in that slot. A deque, so that
+		// adding slots doesn't move the counters setters hold pointers to. Growing it takes the write lock.
+	std::deque<std::atomic<NSInteger>>				_tableCounts;
+
+		// Set once an object whose class uses this map turns out to have a table made with a different map
+	std::atomic<bool>								_hasForeignTables;
+}
+
+- (void) ebn_adjustTableCountsFrom:(const EBNObservationTableSnapshot *) oldSnapshot
+		to:(const EBNObservationTableSnapshot *) newSnapshot;
+
+@end
+
+/****************************************************************************************************
+	EBNObservationTableEndRead()
+
+	Ends a read on the given table. The last reader out frees any retired snapshots.
+*/
+static inline void EBNObservationTableEndRead(EBNObservationTable *table)
+{
+	if (table->_activeReaders.fetch_sub(1) == 1 && table->_hasRetiredSnapshots.load())
+	{
+		[table ebn_reclaimRetiredSnapshots];
+	}
+}
+
+/****************************************************************************************************
+	EBNObservationTableListAtSlot()
+
+	Returns the list at the given slot, or nil.
+*/
+static inline NSArray *EBNObservationTableListAtSlot(const EBNObservationTableSnapshot *snapshot, NSInteger slot)
+{
+	if (!snapshot || slot < 0 || slot >= (NSInteger) snapshot->lists.size())
+		return nil;
+	return snapshot->lists[slot];
+}
+
+/****************************************************************************************************
+	EBNFreeSnapshots()
+
+	Deletes the given snapshots. Call this outside of any syncs; freeing snapshots can release the last
+	reference to observations, and those can run arbitrary dealloc code.
+*/
+static void EBNFreeSnapshots(std::vector<EBNObservationTableSnapshot *> &snapshots)
+{
+	for (EBNObservationTableSnapshot *snapshot : snapshots)
+	{
+		delete snapshot;
+	}
+	snapshots.clear();
+}
+
+
+@implementation EBNPropertySlotMap
+{
+	NSMutableDictionary		*_slotsForKeys;		// NSString -> NSNumber
+	NSMutableArray			*_keysForSlots;
+}
+
+/****************************************************************************************************
+	init
+
+*/
+- (instancetype) init
+{
+	if (self = [super init])
+	{
+		pthread_rwlock_init(&_slotLock, NULL);
+		_slotsForKeys = [@{ @"*" : @0 } mutableCopy];
+		_keysForSlots = [@[ @"*" ] mutableCopy];
+		_tableCounts.emplace_back(0);
+		_hasForeignTables = false;
+	}
+	return self;
+}
+
+/****************************************************************************************************
+	dealloc
+
+*/
+- (void) dealloc
+{
+	pthread_rwlock_destroy(&_slotLock);
+}
+
+/****************************************************************************************************
+	slotForKey:create:
+
+	Lookups take the read lock; only creating a new slot takes the write lock.
+*/
+- (NSInteger) slotForKey:(NSString *) key create:(BOOL) create
+{
+	NSInteger slot = NSNotFound;
+
+	pthread_rwlock_rdlock(&_slotLock);
+	NSNumber *slotNumber = _slotsForKeys[key];
+	pthread_rwlock_unlock(&_slotLock);
+
+	if (slotNumber)
+	{
+		slot = [slotNumber integerValue];
+	}
+	else if (create)
+	{
+		pthread_rwlock_wrlock(&_slotLock);
+		slotNumber = _slotsForKeys[key];
+		if (!slotNumber)
+		{
+			slotNumber = @(_keysForSlots.count);
+			_slotsForKeys[key] = slotNumber;
+			[_keysForSlots addObject:[key copy]];
+			_tableCounts.emplace_back(0);
+		}
+		pthread_rwlock_unlock(&_slotLock);
+		slot = [slotNumber integerValue];
+	}
+
+	return slot;
+}
+
+/****************************************************************************************************
+	keyForSlot:
+
+*/
+- (NSString *) keyForSlot:(NSInteger) slot
+{
+	NSString *key = nil;
+
+	pthread_rwlock_rdlock(&_slotLock);
+	if (slot >= 0 && slot < _keysForSlots.count)
+		key = _keysForSlots[slot];
+	pthread_rwlock_unlock(&_slotLock);
+
+	return key;
+}
+
+/****************************************************************************************************
+	noteForeignTable
+
+*/
+- (void) noteForeignTable
+{
+	_hasForeignTables = true;
+}
+
+/****************************************************************************************************
+	ebn_adjustTableCountsFrom:to:
+
+	Called by a table publishing newSnapshot in place of oldSnapshot (either can be null). Counts each slot
+	that gained or lost its list. Every slot in a snapshot already has a counter.
+*/
+- (void) ebn_adjustTableCountsFrom:(const EBNObservationTableSnapshot *) oldSnapshot
+		to:(const EBNObservationTableSnapshot *) newSnapshot
+{
+	size_t oldSize = oldSnapshot ? oldSnapshot->lists.size() : 0;
+	size_t newSize = newSnapshot ? newSnapshot->lists.size() : 0;
+
+	pthread_rwlock_rdlock(&_slotLock);
+	for (size_t slot = 0; slot < MAX(oldSize, newSize); ++slot)
+	{
+		bool wasObserved = slot < oldSize && oldSnapshot->lists[slot];
+		bool isObserved = slot < newSize && newSnapshot->lists[slot];
+		if (wasObserved != isObserved)
+			_tableCounts[slot].fetch_add(isObserved ? 1 : -1);
+	}
+	pthread_rwlock_unlock(&_slotLock);
+}
+
+@end
+
+/****************************************************************************************************
+	EBNSlotMapObservedCounts()
+
+*/
+EBNSlotObservedCounts EBNSlotMapObservedCounts(EBNPropertySlotMap *slotMap, NSInteger slot)
+{
+	EBNSlotObservedCounts counts;
+
+	pthread_rwlock_rdlock(&slotMap->_slotLock);
+	EBAssert(slot >= 0 && slot < (NSInteger) slotMap->_tableCounts.size(), @"Slot has to come from this slot map.");
+	counts._propertyTableCount = &slotMap->_tableCounts[slot];
+	counts._wildcardTableCount = &slotMap->_tableCounts[0];
+	pthread_rwlock_unlock(&slotMap->_slotLock);
+	counts._hasForeignTables = &slotMap->_hasForeignTables;
+
+	return counts;
+}
+
+#pragma mark -
+
+@implementation EBNObservationTable
+
+/****************************************************************************************************
+	initWithSlotMap:
+
+*/
+- (instancetype) initWithSlotMap:(EBNPropertySlotMap *) slotMap
+{
+	if (self = [super init])
+	{
+		_slotMap = slotMap ? slotMap : [[EBNPropertySlotMap alloc] init];
+		_currentSnapshot = nullptr;
+		_activeReaders = 0;
+		_hasRetiredSnapshots = false;
+		_keepAliveEpoch = 0;
+	}
+	return self;
+}
+
+/****************************************************************************************************
+	init
+
+	Tables made this way get their own slot map.
+*/
+- (instancetype) init
+{
+	return [self initWithSlotMap:nil];
+}
+
+/****************************************************************************************************
+	dealloc
+
+	Nobody can be reading the table by now; free the current snapshot and any retired ones.
+*/
+- (void) dealloc
+{
+	EBNObservationTableSnapshot *snapshot = _currentSnapshot.exchange(nullptr);
+	[_slotMap ebn_adjustTableCountsFrom:snapshot to:nullptr];
+	delete snapshot;
+	EBNFreeSnapshots(_retiredSnapshots);
+}
+
+/****************************************************************************************************
+	entriesForKey:
+
+*/
+- (NSArray<EBNKeypathEntryInfo *> *) entriesForKey:(NSString *) key
+{
+	NSInteger slot = [_slotMap slotForKey:key create:NO];
+	if (slot == NSNotFound)
+		return nil;
+
+	_activeReaders.fetch_add(1);
+	NSArray *entries = EBNObservationTableListAtSlot(_currentSnapshot.load(), slot);
+	EBNObservationTableEndRead(self);
+
+	return entries;
+}
+
+/****************************************************************************************************
+	slotMap
+
+*/
+- (EBNPropertySlotMap *) slotMap
+{
+	return _slotMap;
+}
+
+/****************************************************************************************************
+	allKeys
+
+*/
+- (NSArray<NSString *> *) allKeys
+{
+	NSMutableArray *keys = [[NSMutableArray alloc] init];
+
+	_activeReaders.fetch_add(1);
+	EBNObservationTableSnapshot *snapshot = _currentSnapshot.load();
+	if (snapshot)
+	{
+		for (NSInteger slot = 0; slot < (NSInteger) snapshot->lists.size(); ++slot)
+		{
+			if (snapshot->lists[slot])
+				[keys addObject:[_slotMap keyForSlot:slot]];
+		}
+	}
+	EBNObservationTableEndRead(self);
+
+	return keys;
+}
+
+/****************************************************************************************************
+	addEntry:forKey:
+
+	Publishes a new snapshot with the entry appended to the key's list. Returns YES if the key had no
+	entries before this call.
+*/
+- (BOOL) addEntry:(EBNKeypathEntryInfo *) entryInfo forKey:(NSString *) key
+{
+	BOOL keyWasUnobserved = NO;
+	NSInteger slot = [_slotMap slotForKey:key create:YES];
+	std::vector<EBNObservationTableSnapshot *> reclaimedSnapshots;
+
+	@synchronized(self)
+	{
+		EBNObservationTableSnapshot *newSnapshot = [self ebn_copyOfCurrentSnapshot];
+		if (slot >= (NSInteger) newSnapshot->lists.size())
+			newSnapshot->lists.resize(slot + 1);
+
+		NSArray *entries = newSnapshot->lists[slot];
+		keyWasUnobserved = !entries;
+		if (keyWasUnobserved)
+			++newSnapshot->numObservedKeys;
+		newSnapshot->lists[slot] = entries ? [entries arrayByAddingObject:entryInfo] : @[entryInfo];
+
+		[self ebn_publishSnapshot:newSnapshot reclaimInto:reclaimedSnapshots];
+	}
+
+	EBNFreeSnapshots(reclaimedSnapshots);
+	return keyWasUnobserved;
+}
+
+/****************************************************************************************************
+	removeEntry:atIndex:forKey:keyRemoved:
+
+	Important that we match using the key we're given, and don't look inside entryInfo to pull the key
+	from the keypath. If the entry is in the list multiple times, we only remove one instance; if one of
+	the matches is entryInfo itself (as when removing via an observation's root entries), we remove that one.
+*/
+- (EBNKeypathEntryInfo *) removeEntry:(EBNKeypathEntryInfo *) entryInfo atIndex:(NSInteger) pathIndex
+		forKey:(NSString *) key keyRemoved:(BOOL *) keyRemoved
+{
+	EBNKeypathEntryInfo *removedEntry = nil;
+	BOOL listRemoved = NO;
+	std::vector<EBNObservationTableSnapshot *> reclaimedSnapshots;
+
+	NSInteger slot = [_slotMap slotForKey:key create:NO];
+	if (slot != NSNotFound)
+	{
+		@synchronized(self)
+		{
+			NSArray *entries = EBNObservationTableListAtSlot(_currentSnapshot.load(), slot);
+			NSUInteger index = [entries indexOfObjectIdenticalTo:entryInfo];
+			if (index == NSNotFound || entryInfo->_keyPathIndex != pathIndex)
+				index = 0;
+			for (; index < entries.count; ++index)
+			{
+				EBNKeypathEntryInfo *indexedEntry = entries[index];
+				if (indexedEntry->_blockInfo == entryInfo->_blockInfo &&
+						indexedEntry->_keyPathIndex == pathIndex &&
+						indexedEntry->_keyPath == entryInfo->_keyPath)
+				{
+					removedEntry = indexedEntry;
+
+					EBNObservationTableSnapshot *newSnapshot = [self ebn_copyOfCurrentSnapshot];
+					if (entries.count == 1)
+					{
+						newSnapshot->lists[slot] = nil;
+						--newSnapshot->numObservedKeys;
+						listRemoved = YES;
+					}
+					else
+					{
+						NSMutableArray *newEntries = [entries mutableCopy];
+						[newEntries removeObjectAtIndex:index];
+						newSnapshot->lists[slot] = newEntries;
+					}
+					[self ebn_publishSnapshot:newSnapshot reclaimInto:reclaimedSnapshots];
+					break;
+				}
+			}
+		}
+	}
+
+	EBNFreeSnapshots(reclaimedSnapshots);
+
+	if (keyRemoved)
+		*keyRemoved = listRemoved;
+	return removedEntry;
+}
+
+/****************************************************************************************************
+	moveEntriesForKeys:toKeys:
+
+	Moves are applied all at once: every fromKey is removed, and then each toKey gets the list that its
+	corresponding fromKey had. This is the same result the array classes got by moving keys one at a time
+	in the right order, but it only publishes one snapshot.
+*/
+- (void) moveEntriesForKeys:(NSArray<NSString *> *) fromKeys toKeys:(NSArray<NSString *> *) toKeys
+{
+	EBAssert(fromKeys.count == toKeys.count, @"Every key being moved needs a destination.");
+
+	// Get the slots outside the sync; the slot map has its own lock
+	std::vector<NSInteger> fromSlots, toSlots;
+	for (NSUInteger index = 0; index < fromKeys.count; ++index)
+	{
+		fromSlots.push_back([_slotMap slotForKey:fromKeys[index] create:NO]);
+		toSlots.push_back([_slotMap slotForKey:toKeys[index] create:YES]);
+	}
+
+	std::vector<EBNObservationTableSnapshot *> reclaimedSnapshots;
+	@synchronized(self)
+	{
+		EBNObservationTableSnapshot *snapshot = _currentSnapshot.load();
+		if (!snapshot)
+			return;
+
+		EBNObservationTableSnapshot *newSnapshot = [self ebn_copyOfCurrentSnapshot];
+		for (NSInteger fromSlot : fromSlots)
+		{
+			if (EBNObservationTableListAtSlot(newSnapshot, fromSlot))
+			{
+				newSnapshot->lists[fromSlot] = nil;
+				--newSnapshot->numObservedKeys;
+			}
+		}
+		for (size_t index = 0; index < fromSlots.size(); ++index)
+		{
+			NSArray *entries = EBNObservationTableListAtSlot(snapshot, fromSlots[index]);
+			if (!entries)
+				continue;
+
+			NSInteger toSlot = toSlots[index];
+			if (toSlot >= (NSInteger) newSnapshot->lists.size())
+				newSnapshot->lists.resize(toSlot + 1);
+			if (!newSnapshot->lists[toSlot])
+				++newSnapshot->numObservedKeys;
+			newSnapshot->lists[toSlot] = entries;
+		}
+		[self ebn_publishSnapshot:newSnapshot reclaimInto:reclaimedSnapshots];
+	}
+
+	EBNFreeSnapshots(reclaimedSnapshots);
+}
+
+/****************************************************************************************************
+	markKeepAliveForEpoch:
+
+*/
+- (BOOL) markKeepAliveForEpoch:(NSUInteger) epoch
+{
+	return _keepAliveEpoch.exchange(epoch) != epoch;
+}
+
+#pragma mark Snapshot Management
+
+/****************************************************************************************************
+	ebn_copyOfCurrentSnapshot
+
+	Returns a new snapshot with the same lists as the current one, for a writer to modify and publish.
+	Caller must be inside @synchronized(self).
+*/
+- (EBNObservationTableSnapshot *) ebn_copyOfCurrentSnapshot
+{
+	EBNObservationTableSnapshot *snapshot = _currentSnapshot.load();
+	if (snapshot)
+		return new EBNObservationTableSnapshot(*snapshot);
+
+	return new EBNObservationTableSnapshot();
+}
+
+/****************************************************************************************************
+	ebn_publishSnapshot:reclaimInto:
+
+	Makes newSnapshot the current snapshot, and retires the previous one. NewSnapshot must not be
+	mutated after this call. Caller must be inside @synchronized(self).
+
+	Moves the retired snapshots that can be freed now into reclaimed; the caller should free them after
+	leaving the sync.
+*/
+- (void) ebn_publishSnapshot:(EBNObservationTableSnapshot *) newSnapshot
+		reclaimInto:(std::vector<EBNObservationTableSnapshot *> &) reclaimed
+{
+	// Trim trailing empty slots, and publish nullptr instead of an empty table
+	while (!newSnapshot->lists.empty() && !newSnapshot->lists.back())
+		newSnapshot->lists.pop_back();
+	if (!newSnapshot->numObservedKeys)
+	{
+		delete newSnapshot;
+		newSnapshot = nullptr;
+	}
+
+	EBNObservationTableSnapshot *previousSnapshot = _currentSnapshot.exchange(newSnapshot);
+	[_slotMap ebn_adjustTableCountsFrom:previousSnapshot to:newSnapshot];
+	if (previousSnapshot)
+	{
+		_retiredSnapshots.push_back(previousSnapshot);
+		_hasRetiredSnapshots = true;
+	}
+
+	[self ebn_takeReclaimableSnapshots:reclaimed];
+}
+
+/****************************************************************************************************
+	ebn_takeReclaimableSnapshots:
+
+	If no readers are active, hands back all the retired snapshots. Any reader that loaded a retired snapshot
+	incremented the reader count before loading it, so once the count is observed at zero after the snapshot
+	was retired, nobody can still be looking at it. Caller must be inside @synchronized(self).
+*/
+- (void) ebn_takeReclaimableSnapshots:(std::vector<EBNObservationTableSnapshot *> &) reclaimed
+{
+	if (_retiredSnapshots.empty() || _activeReaders.load() != 0)
+		return;
+
+	reclaimed.insert(reclaimed.end(), _retiredSnapshots.begin(), _retiredSnapshots.end());
+	_retiredSnapshots.clear();
+	_hasRetiredSnapshots = false;
+}
+
+/****************************************************************************************************
+	ebn_reclaimRetiredSnapshots
+
+	Called by the last reader out when there are retired snapshots waiting.
+*/
+- (void) ebn_reclaimRetiredSnapshots
+{
+	std::vector<EBNObservationTableSnapshot *> reclaimedSnapshots;
+	@synchronized(self)
+	{
+		[self ebn_takeReclaimableSnapshots:reclaimedSnapshots];
+	}
+
+	EBNFreeSnapshots(reclaimedSnapshots);
+}
+
+@end
+
+#pragma mark -
+
+/****************************************************************************************************
+	EBNObserverSnapshot::EBNObserverSnapshot()
+
+	Looks up the slot for the key, then begins the read. Used by the manual trigger methods and
+	other callers that don't have a slot handy.
+*/
+EBNObserverSnapshot::EBNObserverSnapshot(EBNObservationTable *table, NSString *key, bool includeWildcard) :
+		_table(nil), _entries(nil), _wildcardEntries(nil)
+{
+	if (!table)
+		return;
+
+	begin(table, [table->_slotMap slotForKey:key create:NO], includeWildcard);
+}
+
+/****************************************************************************************************
+	EBNObserverSnapshot::EBNObserverSnapshot()
+
+	The setter version. The slot is only good for tables using the slot map the setter got it from;
+	that's nearly always the case, but an object can end up with a table that was made while the object
+	had a different class (Apple's KVO can add and remove its own subclass underneath us). In that case,
+	look the key up.
+*/
+EBNObserverSnapshot::EBNObserverSnapshot(EBNObservationTable *table, EBNPropertySlotMap *slotMap,
+		NSInteger slot, NSString *key) :
+		_table(nil), _entries(nil), _wildcardEntries(nil)
+{
+	if (!table)
+		return;
+
+	if (table->_slotMap != slotMap)
+		slot = [table->_slotMap slotForKey:key create:NO];
+	begin(table, slot, true);
+}
+
+/****************************************************************************************************
+	EBNObserverSnapshot::begin()
+
+	Begins a read on the table and grabs the lists for the slot. If there aren't any, the read ends
+	immediately--the common case for a setter on an object with no observers on that property.
+*/
+void EBNObserverSnapshot::begin(EBNObservationTable *table, NSInteger slot, bool includeWildcard)
+{
+	table->_activeReaders.fetch_add(1);
+	EBNObservationTableSnapshot *snapshot = table->_currentSnapshot.load();
+	if (snapshot)
+	{
+		if (slot != 0)
+			_entries = EBNObservationTableListAtSlot(snapshot, slot);
+		if (includeWildcard || slot == 0)
+			_wildcardEntries = EBNObservationTableListAtSlot(snapshot, 0);
+	}
+
+	if (_entries || _wildcardEntries)
+	{
+		// Keep the table alive until we're done; observer blocks could release the observed object.
+		_table = table;
+	}
+	else
+	{
+		EBNObservationTableEndRead(table);
+	}
+}
+
+/****************************************************************************************************
+	EBNObserverSnapshot::~EBNObserverSnapshot()
+
+*/
+EBNObserverSnapshot::~EBNObserverSnapshot()
+{
+	if (_table)
+	{
+		EBNObservationTableEndRead(_table);
+	}
+}
@@ -0,0 +1,348 @@
+/****************************************************************************************************
+	EBNScheduleQueue.mm
+	Observable
+
+	Created by Chall Fry on 4/9/18.
+	Copyright (c) 2013-2018 eBay Software Foundation.
+*/
+
+#import <atomic>
+#import <unordered_map>
+#import <pthread.h>
+
+#import "EBNObservableInternal.h"
+
+
+/**
+	The schedule queue holds observations that are waiting to be run at the end of the current event.
+
+	It's split into shards, and each thread pushes onto the shard picked by its thread port, so that threads
+	that are all setting observed properties at once mostly don't touch the same cache lines. Each shard is a
+	lock-free stack: producers push with a compare-and-swap on the head; the consumer (the main thread, in
+	EBN_RunLoopObserverCallBack) takes an entire shard with one atomic exchange. Since the consumer never pops
+	single nodes, there's no ABA problem.
+
+	Each take starts a new epoch. An observation is only pushed once per epoch, and only the first node
+	pushed for a given observed object in an epoch retains it; later nodes for the same object rely on that one.
+	This keeps the queue and the drain's keep-alive array proportional to the number of distinct observations
+	and objects, not the number of property sets. Nodes with a nil observation only exist to keep an object alive.
+	
+	Nodes also record whether they were pushed by a drain thread--the main thread, or a thread running
+	concurrent-safe blocks for a drain. The drain drops those if the block already ran, but carries over
+	ones from other threads. Drain threads and other threads are deduped separately, so that a drain thread's
+	node can't stand in for another thread's.
+*/
+struct EBNScheduledObservation
+{
+	EBNObservation				*_observation;
+	NSObject					*_observed;
+	EBNScheduledObservation		*_next;
+	bool						_scheduledByDrain;
+
+	EBNScheduledObservation(EBNObservation *observation, NSObject *observed, bool scheduledByDrain) :
+			_observation(observation), _observed(observed), _next(nullptr), _scheduledByDrain(scheduledByDrain) { }
+};
+
+	// Each shard gets its own cache line
+struct alignas(64) EBNScheduleQueueShard
+{
+	std::atomic<EBNScheduledObservation *>	_head;
+};
+
+static const NSUInteger			kEBNScheduleQueueShardCount = 16;
+static EBNScheduleQueueShard	EBNScheduleQueueShards[kEBNScheduleQueueShardCount];
+static std::atomic<NSUInteger>	EBNScheduleEpoch(1);
+static pthread_key_t			EBNDrainWorkerKey;
+
+/****************************************************************************************************
+	EBNGetDrainWorkerKey()
+
+	The thread-specific key that marks threads running concurrent-safe blocks for a drain.
+*/
+static inline pthread_key_t EBNGetDrainWorkerKey(void)
+{
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken,
+	^{
+		pthread_key_create(&EBNDrainWorkerKey, NULL);
+	});
+	return EBNDrainWorkerKey;
+}
+
+/****************************************************************************************************
+	EBNSetDrainWorkerThread()
+
+	EBN_RunLoopObserverCallBack calls this on the threads that run concurrent-safe blocks, so that
+	schedules made by those blocks count as coming from the drain.
+*/
+void EBNSetDrainWorkerThread(bool isDrainWorker)
+{
+	pthread_setspecific(EBNGetDrainWorkerKey(), isDrainWorker ? &EBNDrainWorkerKey : NULL);
+}
+
+/****************************************************************************************************
+	EBNIsDrainThread()
+
+	True on the main thread, and on threads running concurrent-safe blocks for a drain.
+*/
+static inline bool EBNIsDrainThread(void)
+{
+	return pthread_main_np() || pthread_getspecific(EBNGetDrainWorkerKey());
+}
+
+/****************************************************************************************************
+	EBNScheduleQueueShardForCurrentThread()
+
+	Mach thread ports are small integers that are mostly sequential, so they spread across the shards well.
+*/
+static inline EBNScheduleQueueShard &EBNScheduleQueueShardForCurrentThread(void)
+{
+	mach_port_t threadPort = pthread_mach_thread_np(pthread_self());
+	return EBNScheduleQueueShards[threadPort % kEBNScheduleQueueShardCount];
+}
+
+/****************************************************************************************************
+	EBNPushScheduledObservation()
+
+*/
+static inline void EBNPushScheduledObservation(EBNObservation *observation, NSObject *observed, bool scheduledByDrain)
+{
+	EBNScheduledObservation *node = new EBNScheduledObservation(observation, observed, scheduledByDrain);
+	EBNScheduleQueueShard &shard = EBNScheduleQueueShardForCurrentThread();
+
+	EBNScheduledObservation *head = shard._head.load(std::memory_order_relaxed);
+	do
+	{
+		node->_next = head;
+	} while (!shard._head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/**
+	Delayed observations with a delivery queue don't go through the schedule queue. Instead, each delivery queue
+	gets a list of observations waiting to run on it. The first observation added to an empty list dispatches a
+	drain onto the queue, unless a drain is already running; the drain takes the whole list, runs it, and then
+	dispatches another drain if more observations were added meanwhile. Each observation is only in a list
+	once, and its observed object is kept alive until the drain that runs it finishes.
+	
+	A delivery list is created when an observation is scheduled on a queue that doesn't have one, and is
+	freed by the drain that finds nothing more was scheduled, so idle queues don't keep a list (or get
+	retained by one). The table lock is held until the list's own lock is taken, both when scheduling and
+	when freeing, so a list can't be freed while an observation is being added to it.
+*/
+struct EBNQueueDelivery
+{
+	dispatch_queue_t				_queue;
+	pthread_mutex_t					_lock;
+	std::vector<EBNObservation *>	_observations;
+	NSMutableArray					*_keepAlive;
+	bool							_drainScheduled;
+};
+
+static pthread_mutex_t				EBNQueueDeliveryTableLock = PTHREAD_MUTEX_INITIALIZER;
+static std::unordered_map<void *, EBNQueueDelivery *> EBNQueueDeliveryTable;
+
+/****************************************************************************************************
+	EBNLockQueueDeliveryForQueue()
+	
+	Returns the delivery list for the given queue, creating it if necessary. The list is returned locked.
+*/
+static EBNQueueDelivery *EBNLockQueueDeliveryForQueue(dispatch_queue_t queue)
+{
+	pthread_mutex_lock(&EBNQueueDeliveryTableLock);
+	EBNQueueDelivery *&delivery = EBNQueueDeliveryTable[(__bridge void *) queue];
+	if (!delivery)
+	{
+		delivery = new EBNQueueDelivery();
+		delivery->_queue = queue;
+		pthread_mutex_init(&delivery->_lock, NULL);
+		delivery->_drainScheduled = false;
+	}
+	EBNQueueDelivery *result = delivery;
+	pthread_mutex_lock(&result->_lock);
+	pthread_mutex_unlock(&EBNQueueDeliveryTableLock);
+
+	return result;
+}
+
+/****************************************************************************************************
+	EBNDrainQueueDelivery()
+	
+	Runs on the delivery queue. Runs everything in the queue's delivery list. Observations scheduled 
+	while this runs (including by the blocks it calls) go into the next drain, which gets dispatched
+	once this one is done. The queue stays marked as draining until then, so that drains for a 
+	concurrent queue don't overlap. If nothing got scheduled, frees the delivery list.
+*/
+static void EBNDrainQueueDelivery(EBNQueueDelivery *delivery)
+{
+	std::vector<EBNObservation *> observations;
+	NSMutableArray *keepAlive = nil;
+	
+	pthread_mutex_lock(&delivery->_lock);
+	observations.swap(delivery->_observations);
+	keepAlive = delivery->_keepAlive;
+	delivery->_keepAlive = nil;
+	pthread_mutex_unlock(&delivery->_lock);
+	
+	NSMutableSet *objectsToReap = nil;
+	for (EBNObservation *blockInfo : observations)
+	{
+		// Clear the flag first, so that changes made from here on schedule the observation again
+		__atomic_store_n(&blockInfo->_deliveryPending, NO, __ATOMIC_SEQ_CST);
+		if (![blockInfo execute])
+		{
+			NSObject *observed = blockInfo->_weakObserved;
+			if (observed)
+			{
+				if (!objectsToReap)
+					objectsToReap = [NSMutableSet set];
+				[objectsToReap addObject:observed];
+			}
+		}
+	}
+	
+	for (NSObject *obj in objectsToReap)
+	{
+		[obj ebn_reapBlocks];
+	}
+
+	// Release the observations before the observed objects
+	observations.clear();
+	keepAlive = nil;
+	
+	// Anything scheduled while we were running didn't dispatch a drain of its own
+	pthread_mutex_lock(&EBNQueueDeliveryTableLock);
+	pthread_mutex_lock(&delivery->_lock);
+	bool needsDrain = !delivery->_observations.empty();
+	delivery->_drainScheduled = needsDrain;
+	if (!needsDrain)
+		EBNQueueDeliveryTable.erase((__bridge void *) delivery->_queue);
+	pthread_mutex_unlock(&delivery->_lock);
+	pthread_mutex_unlock(&EBNQueueDeliveryTableLock);
+	
+	if (needsDrain)
+	{
+		dispatch_async(delivery->_queue,
+		^{
+			EBNDrainQueueDelivery(delivery);
+		});
+	}
+	else
+	{
+		// Out of the table, so nothing else can get to it
+		pthread_mutex_destroy(&delivery->_lock);
+		delete delivery;
+	}
+}
+
+/****************************************************************************************************
+	EBNScheduleObservationOnQueue()
+	
+	Adds the observation to its delivery queue's list, unless it's already there.
+*/
+static void EBNScheduleObservationOnQueue(EBNObservation *observation, NSObject *observed, dispatch_queue_t queue)
+{
+	if (__atomic_exchange_n(&observation->_deliveryPending, YES, __ATOMIC_SEQ_CST))
+		return;
+
+	EBNQueueDelivery *delivery = EBNLockQueueDeliveryForQueue(queue);
+	delivery->_observations.push_back(observation);
+	if (!delivery->_keepAlive)
+		delivery->_keepAlive = [[NSMutableArray alloc] init];
+	[delivery->_keepAlive addObject:observed];
+	bool needsDrain = !delivery->_drainScheduled;
+	delivery->_drainScheduled = true;
+	pthread_mutex_unlock(&delivery->_lock);
+
+	if (needsDrain)
+	{
+		dispatch_async(queue,
+		^{
+			EBNDrainQueueDelivery(delivery);
+		});
+	}
+}
+
+/****************************************************************************************************
+	EBNScheduleObservation()
+
+	Schedules the given observation to run at the end of the current event, keeping observed alive
+	until then. Safe to call from any thread; doesn't lock.
+	
+	Scheduling an observation that's already queued for the upcoming drain does nothing.
+	
+	Observations with a delivery queue are added to that queue's delivery list instead, which briefly locks.
+*/
+void EBNScheduleObservation(EBNObservation *observation, NSObject *observed)
+{
+	if (dispatch_queue_t deliveryQueue = observation->_deliveryQueue)
+	{
+		EBNScheduleObservationOnQueue(observation, observed, deliveryQueue);
+		return;
+	}
+
+	bool scheduledByDrain = EBNIsDrainThread();
+	NSUInteger *scheduledEpoch = scheduledByDrain ? &observation->_scheduledEpoch : &observation->_otherThreadScheduledEpoch;
+	NSUInteger epoch = EBNScheduleEpoch.load();
+	if (__atomic_exchange_n(scheduledEpoch, epoch, __ATOMIC_SEQ_CST) == epoch)
+		return;
+
+	// If another node already retained observed this epoch, this one doesn't need to.
+	EBNObservationTable *table = [observed ebn_observationTable:NO];
+	if (!table || [table markKeepAliveForEpoch:epoch])
+	{
+		EBNPushScheduledObservation(observation, observed, scheduledByDrain);
+		return;
+	}
+	EBNPushScheduledObservation(observation, nil, scheduledByDrain);
+
+	// If a take started while we were pushing, the node that retained observed may get drained before
+	// ours does. Push a keep-alive node that's guaranteed to be taken no earlier than ours.
+	if (EBNScheduleEpoch.load() != epoch)
+		EBNPushScheduledObservation(nil, observed, scheduledByDrain);
+}
+
+/****************************************************************************************************
+	EBNTakeScheduledObservations()
+
+	Empties the schedule queue. Appends the scheduled observations to observations, and their observed
+	objects to keepAlive; the caller should hold keepAlive until the observations have been run. An
+	observation is only queued once per epoch by drain threads and once by other threads, so a single
+	take returns it at most twice.
+	
+	Returns false if nothing was scheduled. Only EBN_RunLoopObserverCallBack should call this.
+*/
+bool EBNTakeScheduledObservations(std::vector<EBNTakenObservation> &observations, NSMutableArray * __strong *keepAlive)
+{
+	bool tookObservations = false;
+
+	// Anything scheduled from here on is for the next take
+	EBNScheduleEpoch.fetch_add(1);
+
+	for (NSUInteger shardIndex = 0; shardIndex < kEBNScheduleQueueShardCount; ++shardIndex)
+	{
+		// Cheap check first, so an idle drain doesn't write to every shard's cache line
+		EBNScheduleQueueShard &shard = EBNScheduleQueueShards[shardIndex];
+		if (!shard._head.load(std::memory_order_relaxed))
+			continue;
+
+		EBNScheduledObservation *node = shard._head.exchange(nullptr, std::memory_order_acquire);
+		while (node)
+		{
+			tookObservations = true;
+			if (node->_observation)
+				observations.push_back({ node->_observation, node->_scheduledByDrain });
+			if (node->_observed)
+			{
+				if (!*keepAlive)
+					*keepAlive = [[NSMutableArray alloc] init];
+				[*keepAlive addObject:node->_observed];
+			}
+
+			EBNScheduledObservation *nextNode = node->_next;
+			delete node;
+			node = nextNode;
+		}
+	}
+
+	return tookObservations;
+}
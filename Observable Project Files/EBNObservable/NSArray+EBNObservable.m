@@ -165,18 +165,19 @@ static void ebn_shadowed_addObjectsFromArray(NSMutableArray *self, SEL _cmd, NSA
 		// in a special way. That special way is to look through every property to find where
 		// the observation may have moved to. And yes, by 'special' you can infer 'because the
 		// data model is designed wrong'.
-		NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-		if (!observedKeysDict)
+		EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+		if (!observationTable)
 			return nil;
 			
 		EBNKeypathEntryInfo *indexedEntry = [entryInfo copy];
 		indexedEntry->_keyPathIndex = pathIndex;
 		
-		@synchronized(observedKeysDict)
+		@synchronized(observationTable)
 		{
-			for (NSString *propertyKey in observedKeysDict.allKeys)
+			for (NSString *propertyKey in [observationTable allKeys])
 			{
-				if (isdigit([propertyKey characterAtIndex:0]) && [observedKeysDict[propertyKey] containsObject:indexedEntry])
+				if (isdigit([propertyKey characterAtIndex:0]) &&
+						[[observationTable entriesForKey:propertyKey] containsObject:indexedEntry])
 				{
 					[super ebn_removeEntry:entryInfo atIndex:pathIndex forProperty:propertyKey];
 				}
@@ -297,17 +298,8 @@ static void ebn_shadowed_addObjectsFromArray(NSMutableArray *self, SEL _cmd, NSA
 */
 - (void) ebn_stopObservationsOnKey:(NSString *) propertyName
 {
-	// Do we have any observers active on this property?
-	NSMutableArray *observers = NULL;
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (!observedKeysDict)
-		return;
-	
-	@synchronized(observedKeysDict)
-	{
-		observers = [observedKeysDict[propertyName] copy];
-	}
-	
+	// Do we have any observers active on this property? The entry list is immutable, so no copy is needed.
+	NSArray *observers = [[self ebn_observationTable:NO] entriesForKey:propertyName];
 	for (EBNKeypathEntryInfo *entry in observers)
 	{
 		[entry ebn_removeObservation];
@@ -332,16 +324,12 @@ static void ebn_shadowed_insertObjectAtIndex(NSMutableArray *self, SEL _cmd, id
 
 	NSMutableArray *adjustObservations = [[NSMutableArray alloc] init];
 
-	// Get a copy of the keys in the observed methods dictionary
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (!observedKeysDict)
+	// Get a copy of the keys in the observation table
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	if (!observationTable)
 		return;
 	
-	NSArray *observedKeys;
-	@synchronized(observedKeysDict)
-	{
-		observedKeys = [observedKeysDict allKeys];
-	}
+	NSArray *observedKeys = [observationTable allKeys];
 	
 	for (NSString *propertyKey in observedKeys)
 	{
@@ -385,35 +373,13 @@ static void ebn_shadowed_insertObjectAtIndex(NSMutableArray *self, SEL _cmd, id
 	
 	if (adjustObservations.count)
 	{
-		// Sort the number type observations that are active
-		[adjustObservations sortUsingComparator:^(NSString *obj1, NSString *obj2)
+		// Move each observation N to (N+1). The table applies all the moves as one change.
+		NSMutableArray *moveToKeys = [[NSMutableArray alloc] initWithCapacity:adjustObservations.count];
+		for (NSString *moveFromPropKey in adjustObservations)
 		{
-			int intVal1 = [obj1 intValue];
-			int intVal2 = [obj2 intValue];
-			
-			if (intVal1 > intVal2)
-				return (NSComparisonResult) NSOrderedDescending;
-			if (intVal1 < intVal2)
-				return (NSComparisonResult)NSOrderedAscending;
-		
-			return (NSComparisonResult)NSOrderedSame;
-		}];
-		
-		@synchronized(observedKeysDict)
-		{
-			// Traverse the observations in decreasing order, moving N to (N+1)
-			for (long moverIndex = adjustObservations.count - 1; moverIndex >= 0; --moverIndex)
-			{
-				NSString *moveFromPropKey = adjustObservations[moverIndex];
-				NSString *moveToPropKey = [NSString stringWithFormat:@"%d", [moveFromPropKey intValue] + 1];
-				NSMutableArray *observers = observedKeysDict[moveFromPropKey];
-				if (observers)
-				{
-					[observedKeysDict removeObjectForKey:moveFromPropKey];
-					[observedKeysDict setObject:observers forKey:moveToPropKey];
-				}
-			}
+			[moveToKeys addObject:[NSString stringWithFormat:@"%d", [moveFromPropKey intValue] + 1]];
 		}
+		[observationTable moveEntriesForKeys:adjustObservations toKeys:moveToKeys];
 	}
 }
 
@@ -437,16 +403,12 @@ static void ebn_shadowed_removeObjectAtIndex(NSMutableArray *self, SEL _cmd, NSU
 
 	NSMutableArray *adjustObservations = [[NSMutableArray alloc] init];
 	
-	// Get a copy of the keys in the observed methods dictionary
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (!observedKeysDict)
+	// Get a copy of the keys in the observation table
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	if (!observationTable)
 		return;
 	
-	NSArray *observedKeys;
-	@synchronized(observedKeysDict)
-	{
-		observedKeys = [observedKeysDict allKeys];
-	}
+	NSArray *observedKeys = [observationTable allKeys];
 
 	for (NSString *observedKey in observedKeys)
 	{
@@ -502,32 +464,13 @@ static void ebn_shadowed_removeObjectAtIndex(NSMutableArray *self, SEL _cmd, NSU
 	
 	if (adjustObservations.count)
 	{
-		// Sort the number type observations that are active
-		[adjustObservations sortUsingComparator:^(NSString *obj1, NSString *obj2)
-		{
-			int intVal1 = [obj1 intValue];
-			int intVal2 = [obj2 intValue];
-			
-			if (intVal1 > intVal2)
-				return (NSComparisonResult) NSOrderedDescending;
-			if (intVal1 < intVal2)
-				return (NSComparisonResult)NSOrderedAscending;
-		
-			return (NSComparisonResult)NSOrderedSame;
-		}];
-		
-		@synchronized(observedKeysDict)
+		// Move each number observation N to (N-1). The table applies all the moves as one change.
+		NSMutableArray *moveToKeys = [[NSMutableArray alloc] initWithCapacity:adjustObservations.count];
+		for (NSString *moveFromPropKey in adjustObservations)
 		{
-			// Traverse the number observations in increasing order, moving N to (N-1)
-			for (int moverIndex = 0; moverIndex < adjustObservations.count; ++moverIndex)
-			{
-				NSString *moveFromPropKey = adjustObservations[moverIndex];
-				NSString *moveToPropKey = [NSString stringWithFormat:@"%d", [moveFromPropKey intValue] - 1];
-				NSMutableArray *observers = observedKeysDict[moveFromPropKey];
-				[observedKeysDict removeObjectForKey:moveFromPropKey];
-				[observedKeysDict setObject:observers forKey:moveToPropKey];
-			}
+			[moveToKeys addObject:[NSString stringWithFormat:@"%d", [moveFromPropKey intValue] - 1]];
 		}
+		[observationTable moveEntriesForKeys:adjustObservations toKeys:moveToKeys];
 	}
 }
 
@@ -636,16 +579,12 @@ static void ebn_shadowed_removeAllObjects(NSMutableArray *self, SEL _cmd)
 	
 	if (prevCount)
 	{
-		// Get a copy of the keys in the observed keys dictionary
-		NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-		if (!observedKeysDict)
+		// Get a copy of the keys in the observation table
+		EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+		if (!observationTable)
 			return;
 			
-		NSArray *observedKeys;
-		@synchronized(observedKeysDict)
-		{
-			observedKeys = [observedKeysDict allKeys];
-		}
+		NSArray *observedKeys = [observationTable allKeys];
 		
 		for (NSString *observedKey in observedKeys)
 		{
@@ -716,15 +655,11 @@ static void ebn_shadowed_addObjectsFromArray(NSMutableArray *self, SEL _cmd, NSA
 	if (!sourceArray.count)
 		return;
 		
-	// Get a copy of the keys in the observed keys dictionary
-	NSArray *observedKeys = nil;
-	NSMutableDictionary *observedKeysDict = [self ebn_observedKeysDict:NO];
-	if (!observedKeysDict)
+	// Get a copy of the keys in the observation table
+	EBNObservationTable *observationTable = [self ebn_observationTable:NO];
+	if (!observationTable)
 		return;
-	@synchronized(observedKeysDict)
-	{
-		observedKeys = [observedKeysDict allKeys];
-	}
+	NSArray *observedKeys = [observationTable allKeys];
 	
 	for (NSString *observedKey in observedKeys)
 	{
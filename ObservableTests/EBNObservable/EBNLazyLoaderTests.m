@@ -305,6 +305,117 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	return 56;
 }
 
+@end
+
+	// 8 is for testing lazy loader methods
+@interface ModelObject8 : NSObject
+
+@property (nonatomic) int			loadedIntProp;
+@property (nonatomic) int			numLoaderCalls;
+@property (nonatomic) BOOL			loaderShouldThrow;
+@end
+
+@implementation ModelObject8
+
++ (void) initialize
+{
+	[self syntheticProperty:@"loadedIntProp" withLazyLoaderMethod:@selector(loadProperty:)];
+}
+
+- (void) loadProperty:(NSString *) propertyToLoad
+{
+	self.numLoaderCalls++;
+	if (self.loaderShouldThrow)
+		@throw [NSException exceptionWithName:@"LoaderException" reason:@"Test loader failure" userInfo:nil];
+	
+	// The inner get bypasses the loader instead of recursing
+	_loadedIntProp = self.loadedIntProp + 10;
+}
+
+@end
+
+	// Diamond-shaped dependencies: bottom depends on left and right, which both depend on base
+@interface DiamondObject : NSObject
+
+@property (nonatomic) int			baseValue;
+@property (nonatomic) int			leftValue;
+@property (nonatomic) int			rightValue;
+@property (nonatomic) int			bottomValue;
+
+@property (nonatomic) int			numLeftCalls;
+@property (nonatomic) int			numRightCalls;
+@property (nonatomic) int			numBottomCalls;
+@end
+
+@implementation DiamondObject
+
++ (void) initialize
+{
+	[self syntheticProperty:@"leftValue" dependsOn:@"baseValue"];
+	[self syntheticProperty:@"rightValue" dependsOn:@"baseValue"];
+	[self syntheticProperty:@"bottomValue" dependsOnPaths:@[@"leftValue", @"rightValue"]];
+}
+
+- (int) leftValue
+{
+	self.numLeftCalls++;
+	return _leftValue = self.baseValue + 1;
+}
+
+- (int) rightValue
+{
+	self.numRightCalls++;
+	return _rightValue = self.baseValue * 2;
+}
+
+- (int) bottomValue
+{
+	self.numBottomCalls++;
+	return _bottomValue = self.leftValue + self.rightValue;
+}
+
+@end
+
+	// A chain of synthetic properties, each depending on the one before it
+@interface ChainObject : NSObject
+
+@property (nonatomic) int			baseValue;
+@property (nonatomic) int			level1;
+@property (nonatomic) int			level2;
+@property (nonatomic) int			level3;
+@property (nonatomic) int			level4;
+@property (nonatomic) int			level5;
+@property (nonatomic) int			level6;
+@property (nonatomic) int			level7;
+@property (nonatomic) int			level8;
+
+@property (nonatomic) int			numGetterCalls;
+@end
+
+@implementation ChainObject
+
++ (void) initialize
+{
+	// Declared deepest first, so that declaration order isn't dependency order
+	[self syntheticProperty:@"level8" dependsOn:@"level7"];
+	[self syntheticProperty:@"level7" dependsOn:@"level6"];
+	[self syntheticProperty:@"level6" dependsOn:@"level5"];
+	[self syntheticProperty:@"level5" dependsOn:@"level4"];
+	[self syntheticProperty:@"level4" dependsOn:@"level3"];
+	[self syntheticProperty:@"level3" dependsOn:@"level2"];
+	[self syntheticProperty:@"level2" dependsOn:@"level1"];
+	[self syntheticProperty:@"level1" dependsOn:@"baseValue"];
+}
+
+- (int) level1 { self.numGetterCalls++; return _level1 = self.baseValue + 1; }
+- (int) level2 { self.numGetterCalls++; return _level2 = self.level1 + 1; }
+- (int) level3 { self.numGetterCalls++; return _level3 = self.level2 + 1; }
+- (int) level4 { self.numGetterCalls++; return _level4 = self.level3 + 1; }
+- (int) level5 { self.numGetterCalls++; return _level5 = self.level4 + 1; }
+- (int) level6 { self.numGetterCalls++; return _level6 = self.level5 + 1; }
+- (int) level7 { self.numGetterCalls++; return _level7 = self.level6 + 1; }
+- (int) level8 { self.numGetterCalls++; return _level8 = self.level7 + 1; }
+
 @end
 
 
@@ -602,6 +713,33 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	XCTAssertEqual(lo1.debug_invalidProperties.count, 5, @"All synthetic properties should be invalid at this point.");
 }
 
+	// Invalidating many properties at once only recomputes the ones being observed.
+- (void) testBulkInvalidation
+{
+	[lo1 tell:self when:@"rectProp1" changes:^(LazyLoaderTests *blockSelf, LazyObject1 *observed)
+	{
+		++observed.numObserverCalls;
+	}];
+	[lo1 debug_forceAllPropertiesValid];
+	XCTAssertEqual(lo1.debug_invalidProperties.count, 0, @"All synthetic properties should be valid at this point.");
+	int getterCalls = lo1.numGetterCalls;
+	
+	// FirstName isn't synthetic, so it gets skipped
+	[lo1 invalidatePropertyValues:[NSSet setWithObjects:@"intProp2", @"fullName", @"firstName", nil]];
+	XCTAssertEqualObjects(lo1.debug_invalidProperties, ([NSSet setWithObjects:@"intProp2", @"fullName", nil]),
+			@"Only the given synthetic properties should be invalid.");
+	XCTAssertEqual(lo1.numGetterCalls, getterCalls, @"Unobserved properties shouldn't be recomputed.");
+	
+	// RectProp1 is observed, so it gets recomputed right away, and it reads pointProp1 and sizeProp1
+	[lo1 invalidateAllSyntheticProperties];
+	XCTAssertEqualObjects(lo1.debug_invalidProperties, ([NSSet setWithObjects:@"intProp2", @"fullName", nil]),
+			@"Observed properties and the properties they use should have been recomputed.");
+	XCTAssertEqual(lo1.numGetterCalls, getterCalls + 3, @"Wrong number of calls to getter.");
+	XCTAssertEqual(lo1.intProp2, 55, @"Invalidated property should recompute.");
+	
+	[lo1 stopTellingAboutChanges:self];
+}
+
 - (void) testCollectionCopying
 {
 	ContainerContainingObject	*cco = [[ContainerContainingObject alloc] init];
@@ -829,6 +967,148 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	XCTAssertEqual(x, 56, @"readonly int prop may not have received a backing instance variable.");
 }
 
+	// Tests that loaders can't recurse into themselves, and that a throwing loader doesn't block later loads.
+- (void) testLoaderRecursionGuard
+{
+	ModelObject8 *eight = [[ModelObject8 alloc] init];
+	
+	XCTAssertEqual(eight.loadedIntProp, 10, @"Loader didn't set the property.");
+	XCTAssertEqual(eight.numLoaderCalls, 1, @"Loader should only be called once, even when it reads its own property.");
+	
+	eight.loaderShouldThrow = YES;
+	[eight invalidatePropertyValue:@"loadedIntProp"];
+	XCTAssertThrows(eight.loadedIntProp, @"Loader exception should propagate to the getter's caller.");
+	XCTAssertEqual(eight.numLoaderCalls, 2, @"Loader should be called for an invalid property.");
+	
+	eight.loaderShouldThrow = NO;
+	XCTAssertEqual(eight.loadedIntProp, 20, @"Loader should run again after throwing.");
+	XCTAssertEqual(eight.numLoaderCalls, 3, @"Wrong number of calls to the loader.");
+}
+
+	// A change to the top of a diamond recomputes the bottom once, after both sides have their new values.
+- (void) testDiamondDependencies
+{
+	DiamondObject *diamond = [[DiamondObject alloc] init];
+	__block int observerCalls = 0;
+	__block int observedBottomValue = 0;
+	[diamond tell:self when:@"bottomValue" changes:^(LazyLoaderTests *blockSelf, DiamondObject *observed)
+	{
+		++observerCalls;
+		observedBottomValue = observed.bottomValue;
+	}];
+	XCTAssertEqual(diamond.numBottomCalls, 1, @"Observing bottomValue should compute it.");
+	
+	diamond.baseValue = 5;
+	XCTAssertEqual(diamond.numBottomCalls, 2, @"bottomValue should be recomputed once per change.");
+	XCTAssertEqual(diamond.numLeftCalls, 2, @"leftValue should be recomputed once per change.");
+	XCTAssertEqual(diamond.numRightCalls, 2, @"rightValue should be recomputed once per change.");
+	
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(observerCalls, 1, @"Wrong number of calls to property observer.");
+	XCTAssertEqual(observedBottomValue, 16, @"Observer should see the value computed from both sides' new values.");
+	
+	// Invalidating one side only invalidates what's below it
+	[diamond invalidatePropertyValue:@"leftValue"];
+	XCTAssertEqual(diamond.numLeftCalls, 3, @"leftValue should be recomputed for the observed bottomValue.");
+	XCTAssertEqual(diamond.numRightCalls, 2, @"rightValue doesn't depend on leftValue.");
+	XCTAssertEqual(diamond.numBottomCalls, 3, @"bottomValue should be recomputed once.");
+	
+	[diamond stopTellingAboutChanges:self];
+}
+
+	// A change at the top of a deep chain invalidates the whole chain in one pass.
+- (void) testChainedDependencies
+{
+	ChainObject *chain = [[ChainObject alloc] init];
+	XCTAssertEqual(chain.level8, 8, @"Wrong value at the end of the chain.");
+	XCTAssertEqual(chain.numGetterCalls, 8, @"Each level should be computed once.");
+	
+	// Nobody's observing, so nothing gets recomputed until it's asked for
+	chain.baseValue = 10;
+	XCTAssertEqual(chain.numGetterCalls, 8, @"Unobserved levels shouldn't be recomputed.");
+	XCTAssertEqual([[chain debug_validProperties] count], 0, @"The whole chain should be invalid.");
+	XCTAssertEqual(chain.level8, 18, @"Wrong value at the end of the chain.");
+	XCTAssertEqual(chain.numGetterCalls, 16, @"Each level should be recomputed once.");
+	
+	// Invalidating the middle of the chain leaves the levels above it alone
+	[chain invalidatePropertyValue:@"level5"];
+	XCTAssertEqualObjects([chain debug_validProperties], ([NSSet setWithObjects:@"level1", @"level2", @"level3",
+			@"level4", nil]), @"Only level5 and the levels that depend on it should be invalid.");
+}
+
+	// Tests that setting a synthetic property marks it valid, so the next get doesn't reload it.
+- (void) testSetterMarksPropertyValid
+{
+	ModelObject8 *eight = [[ModelObject8 alloc] init];
+	XCTAssertEqual(eight.loadedIntProp, 10, @"Loader didn't set the property.");
+	
+	[eight invalidatePropertyValue:@"loadedIntProp"];
+	XCTAssertFalse([[eight debug_validProperties] containsObject:@"loadedIntProp"], @"Property should be invalid.");
+	
+	eight.loadedIntProp = 5;
+	XCTAssertTrue([[eight debug_validProperties] containsObject:@"loadedIntProp"], @"Setter should mark the property valid.");
+	XCTAssertEqual(eight.loadedIntProp, 5, @"Getter should return the value that was set.");
+	XCTAssertEqual(eight.numLoaderCalls, 1, @"Loader shouldn't run for a property that was set.");
+	
+	// Non-synthetic properties don't have validity bits; setting one shouldn't mark the synthetic property valid
+	[eight invalidateAllSyntheticProperties];
+	eight.numLoaderCalls = 7;
+	XCTAssertFalse([[eight debug_validProperties] containsObject:@"loadedIntProp"],
+			@"Setting a non-synthetic property marked the synthetic property valid.");
+	XCTAssertEqual(eight.loadedIntProp, 15, @"Synthetic property should have been loaded again.");
+	XCTAssertEqual(eight.numLoaderCalls, 8, @"Loader should run for a property that's still invalid.");
+	XCTAssertEqualObjects([eight debug_validProperties], [NSSet setWithObject:@"loadedIntProp"],
+			@"Only the loaded property should be valid.");
+}
+
+	// Tests synthetic properties added after a class's shadow class gets made, as happens with categories that
+	// load late. Their validity bits don't fit in the bitfield sized when the shadow class was made.
+- (void) testValidityBitfieldOverflow
+{
+	static int classNameCounter = 0;
+	NSString *className = [NSString stringWithFormat:@"LazyOverflowModel%d", classNameCounter++];
+	Class modelClass = objc_allocateClassPair([NSObject class], [className UTF8String], 0);
+	objc_registerClassPair(modelClass);
+
+	int getterCalls[40] = { 0 };
+	int *getterCallsPtr = getterCalls;
+	for (int propIndex = 0; propIndex < 40; ++propIndex)
+	{
+		NSString *propName = [NSString stringWithFormat:@"prop%d", propIndex];
+		IMP getterIMP = imp_implementationWithBlock(^NSString *(id blockSelf)
+		{
+			getterCallsPtr[propIndex]++;
+			return propName;
+		});
+		class_addMethod(modelClass, NSSelectorFromString(propName), getterIMP, "@@:");
+		
+		objc_property_attribute_t attributes[] = { { "T", "@\"NSString\"" }, { "R", "" }, { "N", "" } };
+		class_addProperty(modelClass, [propName UTF8String], attributes, 3);
+		
+		// The first synthetic property makes the shadow class, sizing the bitfield for the properties so far
+		[modelClass syntheticProperty:propName];
+	}
+	
+	NSObject *model = [[modelClass alloc] init];
+	for (int propIndex = 0; propIndex < 40; ++propIndex)
+	{
+		NSString *propName = [NSString stringWithFormat:@"prop%d", propIndex];
+		XCTAssertEqualObjects([model valueForKey:propName], propName, @"Synthetic property has the wrong value.");
+		XCTAssertEqualObjects([model valueForKey:propName], propName, @"Synthetic property has the wrong value.");
+		XCTAssertEqual(getterCalls[propIndex], 1, @"Value of %@ should be cached after the first get.", propName);
+	}
+	XCTAssertEqual([[model debug_validProperties] count], 40, @"All the synthetic properties should be valid.");
+	
+	[model invalidatePropertyValue:@"prop39"];
+	XCTAssertFalse([[model debug_validProperties] containsObject:@"prop39"], @"Property should be invalid.");
+	XCTAssertTrue([[model debug_validProperties] containsObject:@"prop38"], @"Other properties should stay valid.");
+	XCTAssertEqualObjects([model valueForKey:@"prop39"], @"prop39", @"Synthetic property has the wrong value.");
+	XCTAssertEqual(getterCalls[39], 2, @"Invalidated property should be recomputed once.");
+	
+	[model invalidateAllSyntheticProperties];
+	XCTAssertEqual([[model debug_validProperties] count], 0, @"All the synthetic properties should be invalid.");
+}
+
 #pragma mark Performance tests
 
 - (void) testInitializationTimePerformance
@@ -930,6 +1210,169 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	}];
 }
 
+- (void) testObservedSetterPerformance
+{
+	// ModelObject5 is a LazyLoader class, so its instances keep their observation tables in an ivar.
+	ModelObject5 *obj = [[ModelObject5 alloc] init];
+	__block int observerCallCount = 0;
+	[obj tell:self when:@"intProperty29" changes:^(LazyLoaderTests *blockSelf, ModelObject5 *observed)
+	{
+		++observerCallCount;
+	}];
+
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 100000; ++index)
+		{
+			// Sets on unobserved properties of an observed object are the common case
+			obj.intProperty1 = index;
+			obj.intProperty2 = index;
+			obj.intProperty3 = index;
+			obj.intProperty29 = index;
+		}
+	}];
+
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(observerCallCount, 1, @"Observer block should be called once per runloop.");
+}
+
+	// Several threads set properties of their own LazyLoader objects. Setters mark properties valid without
+	// taking any shared lock, so the threads shouldn't slow each other down.
+- (void) testMultithreadedSetterPerformance
+{
+	NSMutableArray *objects = [[NSMutableArray alloc] init];
+	for (int index = 0; index < 4; ++index)
+		[objects addObject:[[ModelObject8 alloc] init]];
+	
+	[self measureBlock:^
+	{
+		dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t threadIndex)
+		{
+			ModelObject8 *obj = objects[threadIndex];
+			for (int index = 0; index < 100000; ++index)
+			{
+				obj.loadedIntProp = index;
+				obj.loaderShouldThrow = NO;
+			}
+		});
+	}];
+	
+	for (ModelObject8 *obj in objects)
+	{
+		XCTAssertEqual(obj.loadedIntProp, 99999, @"Property should have the last value set.");
+		XCTAssertEqual(obj.numLoaderCalls, 0, @"Loader shouldn't run for a property that was set.");
+	}
+}
+
+	// Observing a synthetic property forces it valid. List cells create lots of these observations at once.
+- (void) testObservingSyntheticsPerformance
+{
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 1000; ++index)
+		{
+			LazyObject1 *obj = [[LazyObject1 alloc] init];
+			[obj tell:self when:@"rectProp1" changes:^(LazyLoaderTests *blockSelf, LazyObject1 *observed) { }];
+			[obj tell:self when:@"intProp2" changes:^(LazyLoaderTests *blockSelf, LazyObject1 *observed) { }];
+			[obj tell:self when:@"fullName" changes:^(LazyLoaderTests *blockSelf, LazyObject1 *observed) { }];
+			XCTAssertEqual(obj.debug_validProperties.count, 5, @"Observed synthetic properties should be forced valid.");
+			[obj stopTellingAboutChanges:self];
+		}
+	}];
+}
+
+	// Repeatedly invalidates an object with 100 valid synthetic properties, a few of which are observed
+- (void) testBulkInvalidationPerformance
+{
+	ModelObject5 *obj = [[ModelObject5 alloc] init];
+	NSMutableArray *propNames = [[NSMutableArray alloc] init];
+	for (int index = 1; index <= 100; ++index)
+		[propNames addObject:[NSString stringWithFormat:@"intProperty%d", index]];
+	for (int index = 1; index <= 100; index += 25)
+		[obj tell:self when:propNames[index] changes:^(LazyLoaderTests *blockSelf, ModelObject5 *observed) { }];
+	
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 1000; ++index)
+		{
+			for (NSString *propName in propNames)
+				(void) [obj valueForKey:propName];
+			[obj invalidateAllSyntheticProperties];
+		}
+	}];
+	
+	[obj stopTellingAboutChanges:self];
+}
+
+	// Changes the base value of objects with diamond-shaped and deep chains of observed synthetic properties
+- (void) testDependencyGraphInvalidationPerformance
+{
+	DiamondObject *diamond = [[DiamondObject alloc] init];
+	ChainObject *chain = [[ChainObject alloc] init];
+	[diamond tell:self when:@"bottomValue" changes:^(LazyLoaderTests *blockSelf, DiamondObject *observed) { }];
+	[chain tell:self when:@"level8" changes:^(LazyLoaderTests *blockSelf, ChainObject *observed) { }];
+
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 10000; ++index)
+		{
+			diamond.baseValue = index;
+			chain.baseValue = index;
+		}
+		EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	}];
+	
+	XCTAssertEqual(diamond.bottomValue, 9999 + 1 + 9999 * 2, @"Wrong value at the bottom of the diamond.");
+	XCTAssertEqual(chain.level8, 9999 + 8, @"Wrong value at the end of the chain.");
+	[diamond stopTellingAboutChanges:self];
+	[chain stopTellingAboutChanges:self];
+}
+
+	// Invalidates and recomputes a property that has a loader method
+- (void) testLoaderGetterPerformance
+{
+	ModelObject8 *eight = [[ModelObject8 alloc] init];
+	
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 100000; ++index)
+		{
+			[eight invalidatePropertyValue:@"loadedIntProp"];
+			(void) eight.loadedIntProp;
+		}
+	}];
+}
+
+	// Several threads read cached synthetic properties of a shared object (8 and 16+ byte values), while one of
+	// them occasionally changes a property the others depend on, forcing recomputes.
+- (void) testMultithreadedReadPerformance
+{
+	LazyObject1 *obj = [[LazyObject1 alloc] init];
+	obj.floatProp1 = 1.0;
+	obj.floatProp2 = 2.0;
+	obj.floatProp3 = 3.0;
+	obj.floatProp4 = 4.0;
+	
+	[self measureBlock:^
+	{
+		dispatch_apply(4, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t threadIndex)
+		{
+			CGFloat total = 0;
+			for (int index = 0; index < 100000; ++index)
+			{
+				if (threadIndex == 0 && index % 1000 == 0)
+					obj.floatProp3 = index;
+				
+				total += obj.rectProp1.size.width + obj.sizeProp1.height + obj.pointProp1.y + obj.intProp2;
+			}
+			(void) total;
+		});
+	}];
+	
+	obj.floatProp3 = 7.0;
+	XCTAssertTrue(CGRectEqualToRect(obj.rectProp1, CGRectMake(7.0, 4.0, 1.0, 2.0)), @"Synthetic value is wrong.");
+}
+
 - (void) testCountPropertiesPerformance
 {
 	[self measureBlock:^
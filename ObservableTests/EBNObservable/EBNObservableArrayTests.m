@@ -210,6 +210,35 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	XCTAssertEqual([mao1.array.allObservedProperties count], 0, @"Observations didn't get removed.");
 }
 
+- (void) testArrayObservationHandles
+{
+	[mao1.array addObjectsFromArray:@[@"object0", @"object1"]];
+	
+	EBNObservation *firstHandle = ObservePropertyNoPropCheck(mao1, array.0,
+	{
+		++blockSelf->observerCallCount;
+	});
+	[mao1.array insertObject:@"object2" atIndex:0];
+	EBNObservation *secondHandle = ObservePropertyNoPropCheck(mao1, array.0,
+	{
+		++blockSelf->observerCallCount;
+	});
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	
+	// Both observations have the keypath "array.0", but the first one has followed its element to index 1.
+	// Stopping via the handle only removes that handle's observation.
+	[secondHandle stopObserving:@"array.0"];
+	XCTAssertEqualObjects(mao1.array.allObservedProperties, [NSSet setWithObject:@"1"],
+			@"Stopping one observation removed the wrong array element observation.");
+	
+	[mao1.array removeObjectAtIndex:1];
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self->observerCallCount, 1, @"Remaining observation should still work.");
+	
+	[firstHandle stopObservations];
+	XCTAssertEqual([mao1.array.allObservedProperties count], 0, @"Observations didn't get removed.");
+}
+
 - (void) testArrayIndexObservation
 {
 	[mao1 tell:self when:@"array.#4" changes:^(ObservableArrayTests *blockSelf, ModelArrayObject1 *observed)
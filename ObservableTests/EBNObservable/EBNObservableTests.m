@@ -639,6 +639,27 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	XCTAssertTrue(tmpMOA.objectCWasDealloced, @"Observer didn't dealloc when it went out of scope.");
 }
 
+- (void) testObserverDeallocUnlinksEntries
+{
+	ModelObjectB *modelB = moA.modelObjectBProperty;
+	@autoreleasepool
+	{
+		NSObject *observer = [[NSObject alloc] init];
+		[moA tell:observer when:@"intProperty" changes:^(NSObject *blockSelf, ModelObjectA *observed) { }];
+		[moA tell:observer when:@"modelObjectBProperty.intProperty" changes:^(NSObject *blockSelf, ModelObjectA *observed) { }];
+		XCTAssertEqual([[moA ebn_observationTable:NO] entriesForKey:@"intProperty"].count, 1, @"Observation wasn't added.");
+		XCTAssertEqual([[modelB ebn_observationTable:NO] entriesForKey:@"intProperty"].count, 1, @"Keypath wasn't added.");
+	}
+	
+	// Entries should be gone as soon as the observer is, without anything reaping them
+	XCTAssertEqual([[moA ebn_observationTable:NO] entriesForKey:@"intProperty"].count, 0,
+			@"Observer dealloc should have removed the observation.");
+	XCTAssertEqual([[moA ebn_observationTable:NO] entriesForKey:@"modelObjectBProperty"].count, 0,
+			@"Observer dealloc should have removed the keypath.");
+	XCTAssertEqual([[modelB ebn_observationTable:NO] entriesForKey:@"intProperty"].count, 0,
+			@"Observer dealloc should have removed the keypath from every object along it.");
+}
+
 - (void) testProperBaseClass
 {
     ModelObjectA *tmpMOA = [[ModelObjectA alloc] init];
@@ -958,6 +979,521 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	XCTAssertEqual(observerCallCount, 22, @"Wrong number of calls to observer block.");
 }
 
+// Immed blocks that add or remove observations on the property being set shouldn't affect the set of
+// observers called for that set; changes take effect on the next set.
+- (void) testObservationChangesDuringSetter
+{
+	__block int addedBlockCallCount = 0;
+	NSObject *otherObserver = [[NSObject alloc] init];
+
+	EBNObservation *addedObservation = [[EBNObservation alloc] initForObserved:moA observer:otherObserver
+			immedBlock:^(NSObject *blockSelf, ModelObjectA *observed)
+			{
+				addedBlockCallCount++;
+			}];
+
+	EBNObservation *blockInfo = [[EBNObservation alloc] initForObserved:moA observer:self
+			immedBlock:^(ObservableTests *blockSelf, ModelObjectA *observed)
+			{
+				blockSelf.observerCallCount1++;
+				if (blockSelf.observerCallCount1 == 1)
+					[addedObservation observe:@"intProperty"];
+				else
+					[observed stopTellingAboutChanges:otherObserver];
+			}];
+	[blockInfo observe:@"intProperty"];
+
+	moA.intProperty = 1;
+	XCTAssertEqual(self.observerCallCount1, 1, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(addedBlockCallCount, 0, @"Observation added during the set shouldn't run for that set.");
+	XCTAssertEqual([moA numberOfObservers:@"intProperty"], 2, @"Observation added during the set is missing.");
+
+	moA.intProperty = 2;
+	XCTAssertEqual(self.observerCallCount1, 2, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(addedBlockCallCount, 1, @"Observation removed during the set should still run for that set.");
+	XCTAssertEqual([moA numberOfObservers:@"intProperty"], 1, @"Observation removed during the set is still there.");
+
+	moA.intProperty = 3;
+	XCTAssertEqual(self.observerCallCount1, 3, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(addedBlockCallCount, 1, @"Removed observation got called.");
+}
+
+- (void) testScheduledObservationKeepAlive
+{
+	__block NSUInteger keepAliveCount = 0;
+	ObserveProperty(moA, intProperty,
+	{
+		blockSelf.observerCallCount1++;
+		keepAliveCount = EBN_ObservedObjectBeingDrainedKeepAlive.count;
+	});
+	ObserveProperty(moA, floatProperty,
+	{
+		blockSelf.observerCallCount2++;
+	});
+
+	for (int index = 0; index < 1000; ++index)
+	{
+		moA.intProperty = index;
+		moA.floatProperty = index;
+	}
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+
+	XCTAssertEqual(self.observerCallCount1, 1, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(self.observerCallCount2, 1, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(keepAliveCount, 1, @"Observed object should only be retained once per drain.");
+}
+
+- (void) testDrainCascade
+{
+	// Each block sets a property that another observation watches; the last one sets the first property again.
+	ObserveProperty(moA, intProperty,
+	{
+		blockSelf.observerCallCount1++;
+		observed.floatProperty = observed.intProperty;
+	});
+	ObserveProperty(moA, floatProperty,
+	{
+		blockSelf.observerCallCount2++;
+		observed.intProperty = observed.intProperty + 1;
+	});
+
+	EBNResetDrainStatistics();
+	moA.intProperty = 1;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+
+	XCTAssertEqual(self.observerCallCount1, 1, @"Block should run once per drain, even if it gets rescheduled.");
+	XCTAssertEqual(self.observerCallCount2, 1, @"Block scheduled by another block should run in the same drain.");
+	
+	EBNDrainStatistics stats = EBNGetDrainStatistics();
+	XCTAssertEqual(stats.drainCount, 1, @"Wrong number of drains.");
+	XCTAssertEqual(stats.lastBlocksRun, 2, @"Wrong number of blocks run.");
+	XCTAssertEqual(stats.lastCascadeDepth, 3, @"Wrong cascade depth.");
+	XCTAssertEqual(stats.lastBlocksCarriedOver, 0, @"Blocks rescheduled by the drain shouldn't be carried over.");
+	
+	// The rescheduled block ran in the first drain; nothing should be left over for the next one
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Block shouldn't have been left in the schedule queue.");
+	XCTAssertEqual(EBNGetDrainStatistics().drainCount, 1, @"Nothing should have been drained.");
+}
+
+- (void) testDrainTimeBudget
+{
+	__block int uiCallCount = 0;
+	__block int backgroundCallCount = 0;
+	ObserveProperty(moA, intProperty,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	EBNObservation *uiObservation = NewObservationBlock(moA,
+	{
+		uiCallCount++;
+	});
+	uiObservation.priority = EBNObservationPriorityVisibleUI;
+	[uiObservation observe:@"floatProperty"];
+	EBNObservation *backgroundObservation = NewObservationBlock(moA,
+	{
+		backgroundCallCount++;
+	});
+	backgroundObservation.priority = EBNObservationPriorityBackground;
+	[backgroundObservation observe:@"doubleProperty"];
+
+	// With a tiny budget, the drain runs the VisibleUI block and one budgeted block, and carries over the rest
+	EBNSetDrainTimeBudget(1e-9);
+	moA.intProperty = 1;
+	moA.floatProperty = 1;
+	moA.doubleProperty = 1;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(uiCallCount, 1, @"VisibleUI blocks should always run.");
+	XCTAssertEqual(self.observerCallCount1, 1, @"Normal priority block should run before background blocks.");
+	XCTAssertEqual(backgroundCallCount, 0, @"Background block should have been carried over.");
+	XCTAssertEqual(EBNGetDrainBacklogCount(EBNObservationPriorityBackground), 1, @"Wrong backlog count.");
+	XCTAssertEqual(EBNGetDrainBacklogCount(EBNObservationPriorityNormal), 0, @"Wrong backlog count.");
+	
+	// Changing the property again shouldn't make the carried over block run twice
+	moA.doubleProperty = 2;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(backgroundCallCount, 1, @"Carried over block should run once in the next drain.");
+	XCTAssertEqual(EBNGetDrainBacklogCount(EBNObservationPriorityBackground), 0, @"Backlog should be empty.");
+	
+	EBNSetDrainTimeBudget(0);
+	moA.intProperty = 2;
+	moA.doubleProperty = 3;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 2, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(backgroundCallCount, 2, @"Without a budget, everything should run.");
+}
+
+- (void) testDeliveryQueue
+{
+	__block int queueCallCount = 0;
+	__block BOOL ranOnMainThread = NO;
+	dispatch_queue_t deliveryQueue = dispatch_queue_create("com.ebay.observable.test.delivery", DISPATCH_QUEUE_SERIAL);
+	
+	EBNObservation *blockInfo = NewObservationBlock(moA,
+	{
+		queueCallCount++;
+		ranOnMainThread = [NSThread isMainThread];
+	});
+	blockInfo.deliveryQueue = deliveryQueue;
+	[blockInfo observe:@"intProperty"];
+	
+	// Changes before the queue gets to run coalesce into one call
+	for (int index = 0; index < 100; ++index)
+	{
+		moA.intProperty = index;
+	}
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	dispatch_sync(deliveryQueue, ^{ });
+	XCTAssertEqual(queueCallCount, 1, @"Wrong number of calls to observer block.");
+	XCTAssertFalse(ranOnMainThread, @"Observer block should run on its delivery queue.");
+	
+	moA.intProperty = 1000;
+	dispatch_sync(deliveryQueue, ^{ });
+	XCTAssertEqual(queueCallCount, 2, @"Wrong number of calls to observer block.");
+}
+
+// Once nothing delivers on a queue anymore, the queue shouldn't be kept alive by its delivery list
+- (void) testDeliveryQueueReleased
+{
+	__block int queueCallCount = 0;
+	__weak dispatch_queue_t weakQueue = nil;
+	
+	@autoreleasepool
+	{
+		dispatch_queue_t deliveryQueue = dispatch_queue_create("com.ebay.observable.test.delivery", DISPATCH_QUEUE_SERIAL);
+		weakQueue = deliveryQueue;
+		
+		EBNObservation *blockInfo = NewObservationBlock(moA,
+		{
+			queueCallCount++;
+		});
+		blockInfo.deliveryQueue = deliveryQueue;
+		[blockInfo observe:@"intProperty"];
+		
+		moA.intProperty = 5;
+		dispatch_sync(deliveryQueue, ^{ });
+		XCTAssertEqual(queueCallCount, 1, @"Wrong number of calls to observer block.");
+		
+		[blockInfo stopObservations];
+	}
+	
+	// The queue may still be finishing up the drain
+	for (int tries = 0; tries < 100 && weakQueue; ++tries)
+		[NSThread sleepForTimeInterval:0.01];
+	XCTAssertNil(weakQueue, @"Delivery queue should be freed once nothing uses it.");
+}
+
+- (void) testConcurrentSafeDrain
+{
+	__block int concurrentCallCount = 0;
+	__block int concurrentCallsSeenByMainThreadBlock = 0;
+	__block BOOL mainThreadBlockRanOnMainThread = NO;
+	NSMutableArray *observedObjects = [[NSMutableArray alloc] init];
+	for (int index = 0; index < 100; ++index)
+	{
+		ModelObjectA *observedObject = [[ModelObjectA alloc] init];
+		EBNObservation *blockInfo = NewObservationBlock(observedObject,
+		{
+			__atomic_fetch_add(&concurrentCallCount, 1, __ATOMIC_SEQ_CST);
+		});
+		blockInfo.isConcurrentSafe = YES;
+		[blockInfo observe:@"intProperty"];
+		[observedObjects addObject:observedObject];
+	}
+	
+	// Main thread blocks run after the concurrent blocks are done
+	ModelObjectA *firstObject = observedObjects[0];
+	ObserveProperty(firstObject, intProperty,
+	{
+		mainThreadBlockRanOnMainThread = [NSThread isMainThread];
+		concurrentCallsSeenByMainThreadBlock = __atomic_load_n(&concurrentCallCount, __ATOMIC_SEQ_CST);
+	});
+	
+	for (ModelObjectA *observedObject in observedObjects)
+	{
+		observedObject.intProperty = 5;
+		observedObject.intProperty = 6;
+	}
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(concurrentCallCount, 100, @"Each concurrent-safe block should run once.");
+	XCTAssertEqual(concurrentCallsSeenByMainThreadBlock, 100, @"Concurrent blocks should finish before other blocks run.");
+	XCTAssertTrue(mainThreadBlockRanOnMainThread, @"Blocks not marked concurrent-safe should run on the main thread.");
+}
+
+// A concurrent-safe block whose property gets changed by another thread after the block ran should
+// be run again by the next drain, and see the new value.
+- (void) testConcurrentSafeRescheduledByOtherThread
+{
+	__block int concurrentCallCount = 0;
+	__block int lastValueSeen = 0;
+	EBNObservation *blockInfo = NewObservationBlock(moA,
+	{
+		__atomic_fetch_add(&concurrentCallCount, 1, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&lastValueSeen, observed.intProperty, __ATOMIC_SEQ_CST);
+	});
+	blockInfo.isConcurrentSafe = YES;
+	[blockInfo observe:@"intProperty"];
+	
+	// Main thread blocks run after the concurrent blocks are done; this one has another thread change intProperty
+	ObserveProperty(moA, floatProperty,
+	{
+		blockSelf.observerCallCount1++;
+		dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+		^{
+			observed.intProperty = 7;
+		});
+	});
+	
+	moA.intProperty = 5;
+	moA.floatProperty = 5;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(concurrentCallCount, 1, @"Concurrent-safe block should run once per drain.");
+	XCTAssertEqual(lastValueSeen, 5, @"Wrong value seen by concurrent-safe block.");
+	XCTAssertEqual(self.observerCallCount1, 1, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(EBNGetDrainStatistics().lastBlocksCarriedOver, 1, @"Rescheduled block should be carried over.");
+	
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(concurrentCallCount, 2, @"Change made by the other thread should be delivered by the next drain.");
+	XCTAssertEqual(lastValueSeen, 7, @"Concurrent-safe block should see the other thread's change.");
+	XCTAssertEqual(self.observerCallCount1, 1, @"Wrong number of calls to observer block.");
+}
+
+- (void) testObserverReverseIndex
+{
+	NSObject *otherObserver = [[NSObject alloc] init];
+	EBNObservation *blockInfo = ObserveProperty(moA, intProperty,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	[blockInfo observe:@"modelObjectBProperty.intProperty"];
+	[moA tell:otherObserver when:@"intProperty" changes:^(NSObject *blockSelf, ModelObjectA *observed) { }];
+	
+	XCTAssertEqual([EBNObservation ebn_observationsForObserver:self].count, 1, @"Observer should have one observation.");
+	XCTAssertEqual([EBNObservation ebn_observationsForObserver:otherObserver].count, 1,
+			@"Observer should have one observation.");
+	
+	// Stopping one keypath leaves the observation in the index
+	[moA stopTelling:self aboutChangesTo:@"modelObjectBProperty.intProperty"];
+	XCTAssertEqual([moA numberOfObservers:@"modelObjectBProperty"], 0, @"Keypath wasn't removed.");
+	XCTAssertEqual([moA numberOfObservers:@"intProperty"], 2, @"Wrong keypath was removed.");
+	XCTAssertEqual([EBNObservation ebn_observationsForObserver:self].count, 1, @"Observation still has a keypath.");
+	
+	// Stopping the observation removes it from the index, and doesn't affect the other observer
+	[blockInfo stopObservations];
+	XCTAssertEqual([moA numberOfObservers:@"intProperty"], 1, @"stopObservations didn't remove the keypath.");
+	XCTAssertEqual([EBNObservation ebn_observationsForObserver:self].count, 0, @"Observation should leave the index.");
+	
+	[moA stopTellingAboutChanges:otherObserver];
+	XCTAssertEqual([moA numberOfObservers:@"intProperty"], 0, @"stopTellingAboutChanges didn't remove the keypath.");
+	
+	moA.intProperty = 1234;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 0, @"Removed observation got called.");
+}
+
+- (void) testPropertySlotMap
+{
+	EBNPropertySlotMap *slotMap = [[EBNPropertySlotMap alloc] init];
+	XCTAssertEqual([slotMap slotForKey:@"*" create:NO], 0, @"The \"*\" key should always be slot 0.");
+	XCTAssertEqual([slotMap slotForKey:@"intProperty" create:NO], NSNotFound, @"Lookups shouldn't create slots.");
+	
+	NSInteger intSlot = [slotMap slotForKey:@"intProperty" create:YES];
+	NSInteger floatSlot = [slotMap slotForKey:@"floatProperty" create:YES];
+	XCTAssertEqual(intSlot, 1, @"Slots should be assigned in order.");
+	XCTAssertEqual(floatSlot, 2, @"Slots should be assigned in order.");
+	XCTAssertEqual([slotMap slotForKey:[NSMutableString stringWithString:@"intProperty"] create:NO], intSlot,
+			@"Any string equal to the key should find its slot.");
+	XCTAssertEqual([slotMap slotForKey:@"intProperty" create:YES], intSlot, @"Slots shouldn't get reassigned.");
+	XCTAssertEqualObjects([slotMap keyForSlot:floatSlot], @"floatProperty", @"Wrong key for slot.");
+	XCTAssertNil([slotMap keyForSlot:3], @"Unassigned slots shouldn't have keys.");
+}
+
+// ModelObjectA isn't a LazyLoader class, so its instances keep their observation tables in associated objects,
+// and its setters use the slot map's counts to skip looking up tables.
+- (void) testObservationTableLookupAndRemoval
+{
+	ModelObjectA *otherA = [[ModelObjectA alloc] init];
+	EBNObservation *intObservation = ObserveProperty(moA, intProperty,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	ObserveProperty(otherA, floatProperty,
+	{
+		blockSelf.observerCallCount2++;
+	});
+	
+	EBNObservationTable *table = [moA ebn_observationTable:NO];
+	XCTAssertEqual(table.slotMap, [otherA ebn_observationTable:NO].slotMap, @"Instances of a class should share a slot map.");
+	XCTAssertEqual([table entriesForKey:@"intProperty"].count, 1, @"Observation wasn't added.");
+	XCTAssertNil([table entriesForKey:@"floatProperty"], @"Observation was added to the wrong object.");
+	XCTAssertEqualObjects([table allKeys], @[@"intProperty"], @"Wrong observed keys.");
+	
+	// Both setters are overridden, but each object only observes one of the properties
+	otherA.intProperty = 5;
+	moA.floatProperty = 5;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 0, @"Observer of another object's property got called.");
+	XCTAssertEqual(self.observerCallCount2, 0, @"Observer of another object's property got called.");
+	
+	moA.intProperty = 5;
+	otherA.floatProperty = 5;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(self.observerCallCount2, 1, @"Wrong number of calls to observer block.");
+	
+	// Once nothing observes intProperty, setting it shouldn't call anything
+	[intObservation stopObservations];
+	XCTAssertNil([table entriesForKey:@"intProperty"], @"Observation wasn't removed.");
+	XCTAssertEqual([table allKeys].count, 0, @"Table should be empty.");
+	moA.intProperty = 6;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Removed observation got called.");
+	
+	// A "*" observation should see sets of intProperty, even with no instance observing intProperty itself
+	__block int wildcardCallCount = 0;
+	EBNObservation *wildcardObservation = NewObservationBlock(moA,
+	{
+		wildcardCallCount++;
+	});
+	[wildcardObservation observe:@"*"];
+	moA.intProperty = 7;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(wildcardCallCount, 1, @"Wildcard observation should see the set.");
+	
+	// Observing the property again after removing it should work
+	[wildcardObservation stopObservations];
+	ObserveProperty(moA, intProperty,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	moA.intProperty = 8;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 2, @"Re-added observation should get called.");
+	XCTAssertEqual(wildcardCallCount, 1, @"Removed wildcard observation got called.");
+}
+
+- (void) testKeypathInterning
+{
+	NSString *pathString = [NSString stringWithFormat:@"%@.%@", @"modelObjectBProperty", @"intProperty"];
+	XCTAssertNil([EBNKeypath existingKeypathForString:@"neverObserved.intProperty"], @"Keypath shouldn't be interned yet.");
+	
+	EBNKeypath *keypath1 = [EBNKeypath keypathForString:@"modelObjectBProperty.intProperty"];
+	EBNKeypath *keypath2 = [EBNKeypath keypathForString:pathString];
+	EBNKeypath *keypath3 = [EBNKeypath keypathForString:@"modelObjectBProperty.stringProperty"];
+	XCTAssertEqual(keypath1, keypath2, @"Equal keypath strings should intern to the same keypath.");
+	XCTAssertNotEqual(keypath1->_keypathID, keypath3->_keypathID, @"Different keypaths should have different IDs.");
+	XCTAssertEqual(keypath1[0], keypath3[0], @"Keypath components should be interned.");
+	XCTAssertEqual(keypath1.count, 2, @"Wrong number of keypath components.");
+	
+	// Stopping an observation works with any string equal to the keypath
+	ModelObjectA *otherModel = [[ModelObjectA alloc] init];
+	otherModel.modelObjectBProperty = [[ModelObjectB alloc] init];
+	[otherModel tell:self when:@"modelObjectBProperty.intProperty" changes:
+			^(ObservableTests *blockSelf, ModelObjectA *observed)
+			{
+				blockSelf.observerCallCount1++;
+			}];
+	[otherModel stopTelling:self aboutChangesTo:pathString];
+	XCTAssertEqual([otherModel numberOfObservers:@"modelObjectBProperty"], 0, @"Observation wasn't removed.");
+	
+	// Keypaths that nothing holds on to don't stay in the intern table
+	@autoreleasepool
+	{
+		EBNKeypath *unheldKeypath = [EBNKeypath keypathForString:@"neverObserved.floatProperty"];
+		XCTAssertEqual([EBNKeypath existingKeypathForString:@"neverObserved.floatProperty"], unheldKeypath,
+				@"Keypath should be interned while it's held.");
+	}
+	XCTAssertNil([EBNKeypath existingKeypathForString:@"neverObserved.floatProperty"],
+			@"Keypath should leave the intern table once nothing holds it.");
+}
+
+- (void) testAccessorSelectorCache
+{
+	// Look up twice; the second lookup comes from the cache
+	for (int index = 0; index < 2; ++index)
+	{
+		XCTAssertEqual(ebn_selectorForPropertySetter([ModelObjectB class], @"intProperty"),
+				@selector(customIntPropertySetter:), @"Wrong setter for property with custom setter.");
+		XCTAssertEqual(ebn_selectorForPropertyGetter([ModelObjectB class], @"intProperty"),
+				@selector(intProperty), @"Wrong getter for property.");
+		XCTAssertEqual(ebn_selectorForPropertySetter([ModelObjectB class], @"readonlyProperty"), (SEL) nil,
+				@"Readonly property shouldn't have a setter.");
+	}
+	
+	// Comparing values through the cached getters needs to see values set through the shadow class's setters
+	ObserveProperty(moA, modelObjectBProperty.intProperty,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	ModelObjectB *otherModelB = [[ModelObjectB alloc] init];
+	otherModelB.intProperty = moA.modelObjectBProperty.intProperty + 1;
+	moA.modelObjectBProperty = otherModelB;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Changing the object in the keypath changed the endpoint value.");
+	
+	ModelObjectB *sameValueModelB = [[ModelObjectB alloc] init];
+	sameValueModelB.intProperty = otherModelB.intProperty;
+	moA.modelObjectBProperty = sameValueModelB;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Changing the object in the keypath didn't change the endpoint value.");
+}
+
+- (void) testChangeBatch
+{
+	__block int immedCallCount = 0;
+	ObserveProperty(moA, intProperty,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	ObserveProperty(moA, modelObjectBProperty.intProperty,
+	{
+		blockSelf.observerCallCount2++;
+	});
+	EBNObservation *blockInfo = [[EBNObservation alloc] initForObserved:moA observer:self
+			immedBlock:^(ObservableTests *blockSelf, ModelObjectA *observed)
+			{
+				immedCallCount++;
+			}];
+	[blockInfo observe:@"intProperty"];
+	
+	ModelObjectB *otherModelB = [[ModelObjectB alloc] init];
+	otherModelB.intProperty = moA.modelObjectBProperty.intProperty + 1;
+
+	// Nested batches; nothing should happen until the outer commit
+	[NSObject ebn_beginChanges];
+	for (int index = 1; index <= 100; ++index)
+	{
+		moA.intProperty = index;
+		[NSObject ebn_beginChanges];
+		moA.modelObjectBProperty = otherModelB;
+		[NSObject ebn_commitChanges];
+	}
+	XCTAssertEqual(immedCallCount, 0, @"Immediate blocks shouldn't be called inside a batch.");
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 0, @"Observers shouldn't be scheduled inside a batch.");
+	XCTAssertEqual(moA.intProperty, 100, @"Setter inside a batch didn't set the value.");
+	
+	[NSObject ebn_commitChanges];
+	XCTAssertEqual(immedCallCount, 1, @"Immediate block should be called once on commit.");
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Wrong number of calls to observer block.");
+	XCTAssertEqual(self.observerCallCount2, 1, @"Keypath wasn't updated on commit.");
+	
+	// Keypath should follow the new object after the batch
+	otherModelB.intProperty = 5;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount2, 2, @"Keypath wasn't updated on commit.");
+
+	// A property that ends up back at its starting value didn't change
+	[NSObject ebn_beginChanges];
+	moA.intProperty = 7;
+	moA.intProperty = 100;
+	[NSObject ebn_commitChanges];
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(immedCallCount, 1, @"Unchanged property shouldn't call observers.");
+	XCTAssertEqual(self.observerCallCount1, 1, @"Unchanged property shouldn't call observers.");
+}
+
 // Apple KVO observer. Verifies compatibility betweeen EBNObservable and KVO.
 // Related unit test: testAppleKVOCompatibility.
 - (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change
@@ -1012,6 +1548,125 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 	XCTAssertNotNil(props, @"ebn_allProperties my be borked");
 }
 
+- (void) testWildcardPropertyCache
+{
+	ModelObjectB *modelB1 = [[ModelObjectB alloc] init];
+	ModelObjectB *modelB2 = [modelB1 copy];
+	
+	// Objects of the same class should share one property set, even after they get shadowed
+	NSSet *props = [modelB1 ebn_allProperties];
+	XCTAssertTrue([props containsObject:@"intProperty"], @"ebn_allProperties is missing a property.");
+	XCTAssertEqual(props, [modelB2 ebn_allProperties], @"Objects of the same class should share a property set.");
+	
+	moA.modelObjectBProperty = modelB1;
+	ObservePropertyNoPropCheck(moA, modelObjectBProperty.*,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	XCTAssertEqual(props, [modelB1 ebn_allProperties], @"Shadowing an object shouldn't change its property set.");
+	
+	// Swapping in an object whose properties all have the same values shouldn't call the observer
+	moA.modelObjectBProperty = modelB2;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 0, @"Property values were equal; observer shouldn't be called.");
+	
+	// The second object gets its setters wrapped without going through each property again
+	modelB2.intProperty = 5;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Observer should be called for the new object's properties.");
+	
+	modelB1.intProperty = 6;
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(self.observerCallCount1, 1, @"Observer shouldn't be called for the old object.");
+}
+
+// Makes model classes at runtime, each with 10 object properties named prop0 through prop9. Each call makes new classes,
+// so that tests that care about a class's first observation get classes nobody has observed.
+- (NSArray<Class> *) makeModelClasses:(NSUInteger) classCount
+{
+	static int classNameCounter = 0;
+	NSMutableArray *classes = [[NSMutableArray alloc] init];
+	
+	for (NSUInteger classIndex = 0; classIndex < classCount; ++classIndex)
+	{
+		NSString *className = [NSString stringWithFormat:@"EBNStartupModel%d", classNameCounter++];
+		Class modelClass = objc_allocateClassPair([NSObject class], [className UTF8String], 0);
+		for (int propIndex = 0; propIndex < 10; ++propIndex)
+		{
+			NSString *propName = [NSString stringWithFormat:@"prop%d", propIndex];
+			SEL getter = NSSelectorFromString(propName);
+			SEL setter = NSSelectorFromString([NSString stringWithFormat:@"setProp%d:", propIndex]);
+			
+			// The values live in associated objects, keyed by the getter selector
+			IMP getterIMP = imp_implementationWithBlock(^id (id blockSelf)
+			{
+				return objc_getAssociatedObject(blockSelf, getter);
+			});
+			IMP setterIMP = imp_implementationWithBlock(^(id blockSelf, id newValue)
+			{
+				objc_setAssociatedObject(blockSelf, getter, newValue, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+			});
+			class_addMethod(modelClass, getter, getterIMP, "@@:");
+			class_addMethod(modelClass, setter, setterIMP, "v@:@");
+			
+			objc_property_attribute_t attributes[] = { { "T", "@\"NSString\"" }, { "&", "" }, { "N", "" } };
+			class_addProperty(modelClass, [propName UTF8String], attributes, 3);
+		}
+		objc_registerClassPair(modelClass);
+		[classes addObject:modelClass];
+	}
+	
+	return classes;
+}
+
+- (void) testPrepareForObservation
+{
+	NSArray<Class> *classes = [self makeModelClasses:3];
+	
+	__block BOOL prepared = NO;
+	EBNPrepareClassesForObservation(classes, ^
+	{
+		prepared = YES;
+	});
+	NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5.0];
+	while (!prepared && [timeout timeIntervalSinceNow] > 0)
+	{
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+	}
+	XCTAssertTrue(prepared, @"Preparing classes should call the completion block.");
+	
+	for (Class modelClass in classes)
+	{
+		EBNShadowedClassInfo *info = nil;
+		@synchronized (EBNBaseClassToShadowInfoTable)
+		{
+			info = [EBNBaseClassToShadowInfoTable objectForKey:modelClass];
+		}
+		XCTAssertNotNil(info, @"Preparing a class should make its shadow class.");
+		
+		// Observing an object of a prepared class just isa-swizzles it to the shadow class
+		NSObject *model = [[modelClass alloc] init];
+		[model tell:self when:@"prop3" changes:^(ObservableTests *blockSelf, NSObject *observed)
+		{
+			blockSelf.observerCallCount1++;
+		}];
+		XCTAssertEqual(object_getClass(model), info->_shadowClass, @"Observed object should be the shadow class.");
+		XCTAssertEqual([model class], modelClass, @"Shadow class should hide itself.");
+
+		[model setValue:@"new value" forKey:@"prop3"];
+		EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	}
+	XCTAssertEqual(self.observerCallCount1, 3, @"Wrong number of calls to observer block.");
+	
+	// Collections aren't prepared
+	[NSMutableArray ebn_prepareForObservationOfProperties:nil];
+	@synchronized (EBNBaseClassToShadowInfoTable)
+	{
+		XCTAssertNil([EBNBaseClassToShadowInfoTable objectForKey:[NSMutableArray class]],
+				@"Collection classes shouldn't get prepared.");
+	}
+}
+
 - (void) testClassHiding
 {
 	ModelObjectA *moa = [[ModelObjectA alloc] init];
@@ -1085,8 +1740,306 @@ void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivit
 			@"debugShowAllObservers should catch and warn about the broken observation.");
 }
 
+#pragma mark Performance tests
 
-@end
+// Sets an observed property many times on its own object; run on each writer thread by the contention tests.
+- (void) scheduleContentionWriter:(NSArray *) args
+{
+	ModelObjectA *observedObject = args[0];
+	dispatch_group_t writersDone = args[1];
+	
+	for (int index = 0; index < 10000; ++index)
+	{
+		observedObject.intProperty = index;
+	}
+	dispatch_group_leave(writersDone);
+}
+
+// Each writer thread sets an observed property on its own object, scheduling its observation block every time.
+// Measures the writes plus the drain that merges and dedupes what the threads scheduled.
+- (void) runScheduleContentionTestWithThreadCount:(int) numThreads
+{
+	NSMutableArray *observedObjects = [[NSMutableArray alloc] init];
+	for (int index = 0; index < numThreads; ++index)
+	{
+		ModelObjectA *observedObject = [[ModelObjectA alloc] init];
+		ObserveProperty(observedObject, intProperty,
+		{
+			blockSelf.observerCallCount1++;
+		});
+		[observedObjects addObject:observedObject];
+	}
+	
+	__block int drainCount = 0;
+	[self measureBlock:^
+	{
+		dispatch_group_t writersDone = dispatch_group_create();
+		for (ModelObjectA *observedObject in observedObjects)
+		{
+			dispatch_group_enter(writersDone);
+			NSThread *writer = [[NSThread alloc] initWithTarget:self selector:@selector(scheduleContentionWriter:)
+					object:@[observedObject, writersDone]];
+			[writer start];
+		}
+		dispatch_group_wait(writersDone, DISPATCH_TIME_FOREVER);
+		
+		EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+		++drainCount;
+	}];
+	
+	XCTAssertEqual(self.observerCallCount1, numThreads * drainCount,
+			@"Each observation should be called once per drain, no matter how many times it was scheduled.");
+}
+
+- (void) testScheduleContention1Thread
+{
+	[self runScheduleContentionTestWithThreadCount:1];
+}
+
+- (void) testScheduleContention4Threads
+{
+	[self runScheduleContentionTestWithThreadCount:4];
+}
+
+- (void) testScheduleContention16Threads
+{
+	[self runScheduleContentionTestWithThreadCount:16];
+}
+
+// Boxes property values of a few types through ebn_valueForKey:.
+- (void) testValueForKeyPerformance
+{
+	ModelObjectA *observedObject = moA;
+	observedObject.rectProperty = CGRectMake(1, 2, 3, 4);
+	
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 100000; ++index)
+		{
+			@autoreleasepool
+			{
+				[observedObject ebn_valueForKey:@"intProperty"];
+				[observedObject ebn_valueForKey:@"rectProperty"];
+				[observedObject ebn_valueForKey:@"stringProperty1"];
+			}
+		}
+	}];
+	
+	XCTAssertEqual([[moA ebn_valueForKey:@"rectProperty"] CGRectValue].size.height, 4, @"ebn_valueForKey failed");
+}
+
+// Repoints the middle of an observed keypath between objects, comparing the endpoint values each time.
+- (void) testKeypathRepointPerformance
+{
+	ObserveProperty(moA, modelObjectBProperty.intProperty,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	ModelObjectA *observedObject = moA;
+	ModelObjectB *modelB1 = [[ModelObjectB alloc] init];
+	ModelObjectB *modelB2 = [[ModelObjectB alloc] init];
+	
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 10000; ++index)
+		{
+			observedObject.modelObjectBProperty = (index & 1) ? modelB1 : modelB2;
+		}
+		EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	}];
+	
+	XCTAssertEqual(self.observerCallCount1, 0, @"Endpoint values were equal; observer shouldn't be called.");
+}
+
+// Repoints the middle of a "*" keypath between objects, comparing every property of the endpoints each time.
+- (void) testWildcardRepointPerformance
+{
+	ObservePropertyNoPropCheck(moA, modelObjectBProperty.*,
+	{
+		blockSelf.observerCallCount1++;
+	});
+	ModelObjectA *observedObject = moA;
+	ModelObjectB *modelB1 = [[ModelObjectB alloc] init];
+	ModelObjectB *modelB2 = [modelB1 copy];
+	
+	[self measureBlock:^
+	{
+		for (int index = 0; index < 10000; ++index)
+		{
+			observedObject.modelObjectBProperty = (index & 1) ? modelB1 : modelB2;
+		}
+		EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	}];
+	
+	XCTAssertEqual(self.observerCallCount1, 0, @"Property values were equal; observer shouldn't be called.");
+}
+
+// Schedules one observation on each of 3000 objects, then drains them.
+- (void) testDrainPerformance
+{
+	NSMutableArray *observedObjects = [[NSMutableArray alloc] init];
+	for (int index = 0; index < 3000; ++index)
+	{
+		ModelObjectA *observedObject = [[ModelObjectA alloc] init];
+		ObserveProperty(observedObject, intProperty,
+		{
+			blockSelf.observerCallCount1++;
+		});
+		[observedObjects addObject:observedObject];
+	}
+	
+	EBNResetDrainStatistics();
+	[self measureBlock:^
+	{
+		for (ModelObjectA *observedObject in observedObjects)
+		{
+			observedObject.intProperty++;
+		}
+		EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	}];
+	
+	EBNDrainStatistics stats = EBNGetDrainStatistics();
+	XCTAssertEqual(stats.totalBlocksRun, 3000 * stats.drainCount, @"Each observation should run once per drain.");
+	XCTAssertEqual(self.observerCallCount1, 3000 * stats.drainCount, @"Wrong number of calls to observer block.");
+}
+
+// Drains 2000 concurrent-safe observations that each do a little work, using the given number of threads.
+- (void) runConcurrentDrainTestWithThreadCount:(NSUInteger) numThreads
+{
+	__block int callCount = 0;
+	NSMutableArray *observedObjects = [[NSMutableArray alloc] init];
+	for (int index = 0; index < 2000; ++index)
+	{
+		ModelObjectA *observedObject = [[ModelObjectA alloc] init];
+		EBNObservation *blockInfo = NewObservationBlock(observedObject,
+		{
+			double result = observed.intProperty;
+			for (int step = 0; step < 2000; ++step)
+				result = sqrt(result + step);
+			observed.doubleProperty = result;
+			__atomic_fetch_add(&callCount, 1, __ATOMIC_RELAXED);
+		});
+		blockInfo.isConcurrentSafe = YES;
+		[blockInfo observe:@"intProperty"];
+		[observedObjects addObject:observedObject];
+	}
+	
+	EBNSetDrainConcurrency(numThreads);
+	EBNResetDrainStatistics();
+	[self measureBlock:^
+	{
+		for (ModelObjectA *observedObject in observedObjects)
+		{
+			observedObject.intProperty++;
+		}
+		EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	}];
+	EBNSetDrainConcurrency(0);
+	
+	EBNDrainStatistics stats = EBNGetDrainStatistics();
+	XCTAssertEqual(callCount, 2000 * stats.drainCount, @"Each observation should run once per drain.");
+}
+
+- (void) testConcurrentDrain1Thread
+{
+	[self runConcurrentDrainTestWithThreadCount:1];
+}
+
+- (void) testConcurrentDrain2Threads
+{
+	[self runConcurrentDrainTestWithThreadCount:2];
+}
+
+- (void) testConcurrentDrain4Threads
+{
+	[self runConcurrentDrainTestWithThreadCount:4];
+}
+
+- (void) testConcurrentDrain8Threads
+{
+	[self runConcurrentDrainTestWithThreadCount:8];
+}
+
+// Sets up 500 observers with a few observations each on one object, then removes them one observer at a time.
+- (void) testObserverTeardownPerformance
+{
+	ModelObjectA *observedObject = moA;
+	
+	[self measureBlock:^
+	{
+		NSMutableArray *observers = [[NSMutableArray alloc] init];
+		for (int index = 0; index < 500; ++index)
+		{
+			NSObject *observer = [[NSObject alloc] init];
+			[observedObject tell:observer whenAny:@[@"intProperty", @"floatProperty", @"stringProperty1"]
+					changes:^(NSObject *blockSelf, ModelObjectA *observed) { }];
+			[observers addObject:observer];
+		}
+		
+		for (NSObject *observer in observers)
+		{
+			[observedObject stopTellingAboutChanges:observer];
+		}
+	}];
+	
+	XCTAssertEqual([moA numberOfObservers:@"intProperty"], 0, @"All observations should have been removed.");
+}
 
+// Observes one object each of 120 new model classes, timing just the observations. Each class's first observation
+// builds its shadow class and wraps the setter.
+- (void) testStartupFirstObservationCold
+{
+	[self runStartupObservationTestWithPrewarm:NO];
+}
 
+// Same as above, but the classes get prepared first, as EBNPrepareClassesForObservation() would do at launch.
+- (void) testStartupFirstObservationPrewarmed
+{
+	[self runStartupObservationTestWithPrewarm:YES];
+}
 
+- (void) runStartupObservationTestWithPrewarm:(BOOL) prewarm
+{
+	[self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^
+	{
+		NSArray<Class> *classes = [self makeModelClasses:120];
+		NSMutableArray *models = [[NSMutableArray alloc] init];
+		for (Class modelClass in classes)
+		{
+			if (prewarm)
+				[modelClass ebn_prepareForObservationOfProperties:nil];
+			[models addObject:[[modelClass alloc] init]];
+		}
+		NSObject *observer = [[NSObject alloc] init];
+		
+		[self startMeasuring];
+		for (NSObject *model in models)
+		{
+			[model tell:observer whenAny:@[@"prop0", @"prop5"] changes:^(NSObject *blockSelf, NSObject *observed) { }];
+		}
+		[self stopMeasuring];
+		
+		for (NSObject *model in models)
+		{
+			[model stopTellingAboutChanges:observer];
+		}
+	}];
+}
+
+// Measures the work EBNPrepareClassesForObservation() moves off the main thread, for 120 model classes.
+- (void) testStartupPrewarmTime
+{
+	[self measureMetrics:[[self class] defaultPerformanceMetrics] automaticallyStartMeasuring:NO forBlock:^
+	{
+		NSArray<Class> *classes = [self makeModelClasses:120];
+		
+		[self startMeasuring];
+		for (Class modelClass in classes)
+		{
+			[modelClass ebn_prepareForObservationOfProperties:nil];
+		}
+		[self stopMeasuring];
+	}];
+}
+
+@end
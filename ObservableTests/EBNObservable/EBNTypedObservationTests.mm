@@ -0,0 +1,171 @@
+/****************************************************************************************************
+	EBNTypedObservationTests.mm
+	Observable
+
+    Copyright (c) 2013-2018 eBay Software Foundation.
+
+    Unit tests. Objective-C++, as EBNObserveImmedTyped<T>() is a template.
+*/
+
+#import <XCTest/XCTest.h>
+#import <UIKit/UIKit.h>
+
+#import "EBNObservable.h"
+#import "EBNObservableUnitTestSupport.h"
+
+// This punches the hole that allows us to force the observer notifications
+// instead of being dependent on the run loop. Asynchronous issues
+// have to be handled without this.
+void EBN_RunLoopObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info);
+
+
+// -----------------------------------------------------------------------------
+//                              Test Objects
+// -----------------------------------------------------------------------------
+@interface TypedModelObject : NSObject
+
+@property (assign) int					intProperty;
+@property (assign) double				doubleProperty;
+@property (assign) CGPoint				pointProperty;
+@property (assign) CGRect				rectProperty;
+
+@end
+
+@implementation TypedModelObject
+
+@end
+
+// -----------------------------------------------------------------------------
+//                              Tests
+// -----------------------------------------------------------------------------
+@interface EBNTypedObservationTests : XCTestCase
+{
+	TypedModelObject	*model;
+}
+@end
+
+@implementation EBNTypedObservationTests
+
+- (void) setUp
+{
+	[super setUp];
+	model = [[TypedModelObject alloc] init];
+}
+
+- (void) testTypedDouble
+{
+	__block int callCount = 0;
+	__block double lastPrevValue = 0;
+	__block double lastNewValue = 0;
+
+	model.doubleProperty = 1.5;
+	EBNObserveImmedTyped<double>(self, model, @"doubleProperty",
+			^(id blockSelf, id observed, double previousValue, double newValue)
+			{
+				callCount++;
+				lastPrevValue = previousValue;
+				lastNewValue = newValue;
+			});
+
+	model.doubleProperty = 2.5;
+	XCTAssertEqual(callCount, 1, @"Wrong number of calls to typed observer block.");
+	XCTAssertEqual(lastPrevValue, 1.5, @"Wrong previous value.");
+	XCTAssertEqual(lastNewValue, 2.5, @"Wrong new value.");
+
+	model.doubleProperty = 2.5;
+	XCTAssertEqual(callCount, 1, @"Setting the same value shouldn't call the block.");
+
+	// Manual triggers arrive boxed, and get unboxed into doubles
+	[model ebn_manuallyTriggerObserversForProperty:@"doubleProperty" previousValue:@(0.5)];
+	XCTAssertEqual(callCount, 2, @"Manual trigger should call the typed block.");
+	XCTAssertEqual(lastPrevValue, 0.5, @"Wrong previous value.");
+	XCTAssertEqual(lastNewValue, 2.5, @"Wrong new value.");
+
+	EBN_RunLoopObserverCallBack(nil, kCFRunLoopAfterWaiting, nil);
+	XCTAssertEqual(callCount, 2, @"Typed immediate blocks shouldn't be called at the end of the event.");
+}
+
+- (void) testTypedStruct
+{
+	__block int callCount = 0;
+	__block CGPoint lastPrevValue = CGPointZero;
+	__block CGPoint lastNewValue = CGPointZero;
+
+	model.pointProperty = CGPointMake(1, 2);
+	EBNObserveImmedTyped<CGPoint>(self, model, @"pointProperty",
+			^(id blockSelf, id observed, CGPoint previousValue, CGPoint newValue)
+			{
+				callCount++;
+				lastPrevValue = previousValue;
+				lastNewValue = newValue;
+			});
+
+	model.pointProperty = CGPointMake(3, 4);
+	XCTAssertEqual(callCount, 1, @"Wrong number of calls to typed observer block.");
+	XCTAssertTrue(CGPointEqualToPoint(lastPrevValue, CGPointMake(1, 2)), @"Wrong previous value.");
+	XCTAssertTrue(CGPointEqualToPoint(lastNewValue, CGPointMake(3, 4)), @"Wrong new value.");
+
+	[model ebn_manuallyTriggerObserversForProperty:@"pointProperty" previousValue:[NSValue valueWithCGPoint:CGPointMake(5, 6)]];
+	XCTAssertEqual(callCount, 2, @"Manual trigger should call the typed block.");
+	XCTAssertTrue(CGPointEqualToPoint(lastPrevValue, CGPointMake(5, 6)), @"Boxed value should unbox to the same point.");
+	XCTAssertTrue(CGPointEqualToPoint(lastNewValue, CGPointMake(3, 4)), @"Wrong new value.");
+}
+
+// Typed blocks whose type doesn't match the property's type should assert when they're created.
+- (void) testTypedMismatch
+{
+	__block int callCount = 0;
+	
+	// A CGRect is bigger than a CGPoint; copying one into a CGPoint would overrun it
+	EBAssertAsserts(EBNObserveImmedTyped<CGPoint>(self, model, @"rectProperty",
+			^(id blockSelf, id observed, CGPoint previousValue, CGPoint newValue)
+			{
+				callCount++;
+			}), @"Typed block with the wrong struct type should assert.");
+	
+	// Numbers aren't structs, and structs aren't numbers
+	EBAssertAsserts(EBNObserveImmedTyped<CGPoint>(self, model, @"intProperty",
+			^(id blockSelf, id observed, CGPoint previousValue, CGPoint newValue)
+			{
+				callCount++;
+			}), @"Typed struct block on a number property should assert.");
+	EBAssertAsserts(EBNObserveImmedTyped<double>(self, model, @"pointProperty",
+			^(id blockSelf, id observed, double previousValue, double newValue)
+			{
+				callCount++;
+			}), @"Typed number block on a struct property should assert.");
+	EBAssertAsserts(EBNObserveImmedTyped<double>(self, model, @"intProperty",
+			^(id blockSelf, id observed, double previousValue, double newValue)
+			{
+				callCount++;
+			}), @"Typed block with the wrong number type should assert.");
+	
+	model.rectProperty = CGRectMake(1, 2, 3, 4);
+	model.intProperty = 7;
+	model.pointProperty = CGPointMake(8, 9);
+	XCTAssertEqual(callCount, 0, @"Mismatched typed blocks shouldn't have been registered.");
+}
+
+// Boxed values of the wrong type should unbox to T(), and unboxing mustn't write past the end of the T.
+- (void) testTypedMismatchedBoxedValue
+{
+	__block int callCount = 0;
+	__block CGPoint lastPrevValue = CGPointMake(-1, -1);
+	
+	EBNObserveImmedTyped<CGPoint>(self, model, @"pointProperty",
+			^(id blockSelf, id observed, CGPoint previousValue, CGPoint newValue)
+			{
+				callCount++;
+				lastPrevValue = previousValue;
+			});
+	
+	[model ebn_manuallyTriggerObserversForProperty:@"pointProperty" previousValue:[NSValue valueWithCGRect:CGRectMake(1, 2, 3, 4)]];
+	XCTAssertEqual(callCount, 1, @"Manual trigger should call the typed block.");
+	XCTAssertTrue(CGPointEqualToPoint(lastPrevValue, CGPointZero), @"Mismatched values should come back as T().");
+	
+	[model ebn_manuallyTriggerObserversForProperty:@"pointProperty" previousValue:@(5)];
+	XCTAssertEqual(callCount, 2, @"Manual trigger should call the typed block.");
+	XCTAssertTrue(CGPointEqualToPoint(lastPrevValue, CGPointZero), @"Numbers should come back as T().");
+}
+
+@end